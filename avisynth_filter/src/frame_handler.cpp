@@ -4,26 +4,25 @@
 
 #include "constants.h"
 #include "filter.h"
+#include "thread_budget.h"
 
 
 namespace SynthFilter {
 
 auto FrameHandler::AddInputSample(IMediaSample *inputSample) -> HRESULT {
-    HRESULT hr;
-
     _addInputSampleCv.wait(_filter.m_csReceive, [this]() -> bool {
         if (_isFlushing) {
             return true;
         }
 
-        if (_nextSourceFrameNb <= Environment::GetInstance().GetInitialSrcBuffer()) {
+        if (_nextSourceFrameNb <= _initialSrcBuffer) {
             return true;
         }
 
         UpdateExtraSrcBuffer();
 
         // at least NUM_SRC_FRAMES_PER_PROCESSING source frames are needed in queue for stop time calculation
-        if (static_cast<int>(_sourceFrames.size()) < NUM_SRC_FRAMES_PER_PROCESSING + _extraSrcBuffer) {
+        if (static_cast<int>(_sourceFrames.size()) < GetNumSrcFramesPerProcessing() + _extraSrcBuffer) {
             return true;
         }
 
@@ -35,53 +34,156 @@ auto FrameHandler::AddInputSample(IMediaSample *inputSample) -> HRESULT {
         return S_FALSE;
     }
 
-    if ((_filter._isInputMediaTypeChanged || _filter._needReloadScript) && !ChangeOutputFormat()) {
+    if ((_filter._isInputMediaTypeChanged || (_filter._needReloadScript && !PrepareScriptSwap())) && !ChangeOutputFormat()) {
         return S_FALSE;
     }
 
+    if (_nextSourceFrameNb == 0) {
+        UpdateIngestionQueueDepth();
+        UpdateOutputFrameCacheIdentity();
+
+        // latch the pre-buffer size before the script could be re-evaluated in the background
+        _initialSrcBuffer = GetInitialSrcBuffer();
+
+        // a script surviving a warm flush needs no reload
+        if (!MainFrameServer::GetInstance().IsScriptActive()) {
+            StartScriptReload();
+        }
+    }
+
     REFERENCE_TIME inputSampleStartTime;
     REFERENCE_TIME inputSampleStopTime = 0;
-    if (inputSample->GetTime(&inputSampleStartTime, &inputSampleStopTime) == VFW_E_SAMPLE_TIME_NOT_SET) {
+    const HRESULT getTimeHr = inputSample->GetTime(&inputSampleStartTime, &inputSampleStopTime);
+    if (getTimeHr == VFW_E_SAMPLE_TIME_NOT_SET) {
         // for samples without start time, always treat as fixed frame rate
-        inputSampleStartTime = _nextSourceFrameNb * MainFrameServer::GetInstance().GetSourceAvgFrameDuration();
+        // the main frameserver may still be evaluating the script, so take the frame rate from the input format
+        inputSampleStartTime = _nextSourceFrameNb * GetInputFrameDuration();
     }
 
-    {
-        const std::shared_lock sharedSourceLock(_sourceMutex);
+    // compare with the last accepted sample rather than the last stored frame, since the ingestion thread may not have caught up yet
+    if (const REFERENCE_TIME lastSampleStartTime = _lastSourceFrameStartTime; inputSampleStartTime <= lastSampleStartTime) {
+        Environment::GetInstance().Log(L"Reject input sample due to start time going backward: curr %10lld last %10lld", inputSampleStartTime, lastSampleStartTime);
+        return S_FALSE;
+    }
 
-        // since the key of _sourceFrames is frame number, which only strictly increases, rbegin() returns the last emplaced frame
-        if (const REFERENCE_TIME lastSampleStartTime = _sourceFrames.empty() ? -1 : _sourceFrames.rbegin()->second.startTime;
-            inputSampleStartTime <= lastSampleStartTime) {
-            Environment::GetInstance().Log(L"Reject input sample due to start time going backward: curr %10lld last %10lld", inputSampleStartTime, lastSampleStartTime);
-            return S_FALSE;
-        }
+    /*
+     * The stop time of the source frame is only used in low latency mode, where we can't wait for the next sample to arrive.
+     * Prefer the upstream stop time. If it is not available, predict with the duration of the previous source frame.
+     * Any mis-prediction is corrected when the next source frame is processed.
+     */
+    REFERENCE_TIME sourceFrameStopTime;
+    if (getTimeHr == S_OK && inputSampleStopTime > inputSampleStartTime) {
+        sourceFrameStopTime = inputSampleStopTime;
+    } else if (const REFERENCE_TIME lastSourceFrameStartTime = _lastSourceFrameStartTime; lastSourceFrameStartTime >= 0 && lastSourceFrameStartTime < inputSampleStartTime) {
+        sourceFrameStopTime = inputSampleStartTime + (inputSampleStartTime - lastSourceFrameStartTime);
+    } else {
+        sourceFrameStopTime = inputSampleStartTime + GetInputFrameDuration();
+    }
+
+    if (ShouldDropInputSample()) {
+        _numConsecutiveDroppedSourceFrames += 1;
+        _numDroppedSourceFrames += 1;
+        Environment::GetInstance().Log(L"Drop input sample at %10lld due to overload, total dropped %6d", inputSampleStartTime, _numDroppedSourceFrames);
+        return S_FALSE;
     }
 
     RefreshInputFrameRates(_nextSourceFrameNb);
 
-    BYTE *sampleBuffer;
-    hr = inputSample->GetPointer(&sampleBuffer);
-    if (FAILED(hr)) {
+    std::unique_ptr<HDRSideData> hdrSideData = ReadHDRSideData(inputSample);
+
+    // the frame conversion is done in the ingestion thread so that upstream can proceed with its next frame as early as possible
+    if (!QueueInputSample({ inputSample,
+                            _nextSourceFrameNb,
+                            inputSampleStartTime,
+                            sourceFrameStopTime,
+                            _filter.m_pInput->SampleProps()->dwTypeSpecificFlags,
+                            _numConsecutiveDroppedSourceFrames,
+                            _filter._inputVideoFormat,
+                            std::move(hdrSideData) })) {
         return S_FALSE;
     }
+    _numConsecutiveDroppedSourceFrames = 0;
+
+    Environment::GetInstance().Log(L"Queue source frame: %6d at %10lld ~ %10lld duration(literal) %10lld max_requested %6d extra_buffer %6d",
+                                   _nextSourceFrameNb,
+                                   inputSampleStartTime,
+                                   inputSampleStopTime,
+                                   inputSampleStopTime - inputSampleStartTime,
+                                   _maxRequestedFrameNb.load(),
+                                   _extraSrcBuffer);
+    _nextSourceFrameNb += 1;
+    _lastSourceFrameStartTime = inputSampleStartTime;
+
+    // delay activating the main frameserver until we have enough pre-buffered frames in store
+    // like the pre-buffering above, it takes one frame beyond the initial buffer, except in low latency mode that starts right with the last one
+    if (const bool isPreBufferFilled = Environment::GetInstance().IsLowLatencyEnabled() ? _nextSourceFrameNb >= _initialSrcBuffer : _nextSourceFrameNb > _initialSrcBuffer;
+        !_isMainScriptReady && isPreBufferFilled) {
+        if (!WaitForScriptReload()) {
+            _filter.AbortPlayback(VFW_E_RUNTIME_ERROR);
+            return VFW_E_RUNTIME_ERROR;
+        }
+
+        // only now the lookahead declared by the freshly evaluated script is known
+        _initialSrcBuffer = GetInitialSrcBuffer();
+
+        const std::unique_lock uniqueSourceLock(_sourceMutex);
+        _isMainScriptReady = true;
+    }
 
-    PVideoFrame frame = Format::CreateFrame(_filter._inputVideoFormat, sampleBuffer);
+    _newSourceFrameCv.notify_all();
+
+    return S_OK;
+}
+
+auto FrameHandler::IngestInputSample(InputSampleInfo &inputSampleInfo) -> void {
+    BYTE *sampleBuffer;
+    if (FAILED(inputSampleInfo.sample->GetPointer(&sampleBuffer))) {
+        return;
+    }
+
+    const bool isDuplicate = Environment::GetInstance().IsDuplicateFrameDetectionEnabled()
+        && DetectDuplicateSourceFrame(sampleBuffer, inputSampleInfo.sample->GetActualDataLength());
+
+    // the frame is allocated from the environment of the main frameserver, which must not be swapped until the frame is stored
+    const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+
+    PVideoFrame frame;
+    if (isDuplicate && Environment::GetInstance().IsDuplicateFrameReuseEnabled()) {
+        // share the buffer of the previous source frame to skip the conversion, with its own copy of the frame properties
+        const std::shared_lock sharedSourceLock(_sourceMutex);
+
+        if (const auto iter = _sourceFrames.find(inputSampleInfo.frameNb - 1); iter != _sourceFrames.end() && iter->second.frame && !iter->second.spillSlot) {
+            frame = iter->second.frame;
+        }
+    }
+
+    if (frame) {
+        if (FrameServerCommon::GetInstance().IsFramePropsSupported()) {
+            AVSF_AVS_API->MakePropertyWritable(&frame);
+
+            AVSMap *frameProps = AVSF_AVS_API->getFramePropsRW(frame);
+            AVSF_AVS_API->propDeleteKey(frameProps, FRAME_PROP_NAME_DURATION_NUM);
+            AVSF_AVS_API->propDeleteKey(frameProps, FRAME_PROP_NAME_DURATION_DEN);
+        }
+    } else {
+        frame = Format::CreateFrame(inputSampleInfo.videoFormat, sampleBuffer);
+    }
 
     if (FrameServerCommon::GetInstance().IsFramePropsSupported()) {
         AVSMap *frameProps = AVSF_AVS_API->getFramePropsRW(frame);
 
-        AVSF_AVS_API->propSetFloat(frameProps, FRAME_PROP_NAME_ABS_TIME, inputSampleStartTime / static_cast<double>(UNITS), PROPAPPENDMODE_REPLACE);
-        AVSF_AVS_API->propSetInt(frameProps, "_SARNum", _filter._inputVideoFormat.pixelAspectRatioNum, PROPAPPENDMODE_REPLACE);
-        AVSF_AVS_API->propSetInt(frameProps, "_SARDen", _filter._inputVideoFormat.pixelAspectRatioDen, PROPAPPENDMODE_REPLACE);
+        AVSF_AVS_API->propSetFloat(frameProps, FRAME_PROP_NAME_ABS_TIME, inputSampleInfo.startTime / static_cast<double>(UNITS), PROPAPPENDMODE_REPLACE);
+        AVSF_AVS_API->propSetInt(frameProps, "_SARNum", inputSampleInfo.videoFormat.pixelAspectRatioNum, PROPAPPENDMODE_REPLACE);
+        AVSF_AVS_API->propSetInt(frameProps, "_SARDen", inputSampleInfo.videoFormat.pixelAspectRatioDen, PROPAPPENDMODE_REPLACE);
 
-        if (const std::optional<int> &optColorRange = _filter._inputVideoFormat.colorSpaceInfo.colorRange) {
+        if (const std::optional<int> &optColorRange = inputSampleInfo.videoFormat.colorSpaceInfo.colorRange) {
             AVSF_AVS_API->propSetInt(frameProps, "_ColorRange", *optColorRange, PROPAPPENDMODE_REPLACE);
         }
-        AVSF_AVS_API->propSetInt(frameProps, "_Primaries", _filter._inputVideoFormat.colorSpaceInfo.primaries, PROPAPPENDMODE_REPLACE);
-        AVSF_AVS_API->propSetInt(frameProps, "_Matrix", _filter._inputVideoFormat.colorSpaceInfo.matrix, PROPAPPENDMODE_REPLACE);
-        AVSF_AVS_API->propSetInt(frameProps, "_Transfer", _filter._inputVideoFormat.colorSpaceInfo.transfer, PROPAPPENDMODE_REPLACE);
+        AVSF_AVS_API->propSetInt(frameProps, "_Primaries", inputSampleInfo.videoFormat.colorSpaceInfo.primaries, PROPAPPENDMODE_REPLACE);
+        AVSF_AVS_API->propSetInt(frameProps, "_Matrix", inputSampleInfo.videoFormat.colorSpaceInfo.matrix, PROPAPPENDMODE_REPLACE);
+        AVSF_AVS_API->propSetInt(frameProps, "_Transfer", inputSampleInfo.videoFormat.colorSpaceInfo.transfer, PROPAPPENDMODE_REPLACE);
 
-        const DWORD typeSpecificFlags = _filter.m_pInput->SampleProps()->dwTypeSpecificFlags;
+        const DWORD typeSpecificFlags = inputSampleInfo.typeSpecificFlags;
         // C++ lacks if-expression, so use IIFE to simulate
         const int rfpFieldBased = [&]() {
             if (typeSpecificFlags & AM_VIDEO_FLAG_WEAVE) {
@@ -93,22 +195,13 @@ auto FrameHandler::AddInputSample(IMediaSample *inputSample) -> HRESULT {
             }
         }();
         AVSF_AVS_API->propSetInt(frameProps, FRAME_PROP_NAME_FIELD_BASED, rfpFieldBased, PROPAPPENDMODE_REPLACE);
-    }
-
-    std::unique_ptr<HDRSideData> hdrSideData = std::make_unique<HDRSideData>();
-    {
-        if (const ATL::CComQIPtr<IMediaSideData> inputSampleSideData(inputSample); inputSampleSideData != nullptr) {
-            hdrSideData->ReadFrom(inputSampleSideData);
 
-            if (const std::optional<const BYTE *> optHdr = hdrSideData->GetHDRData()) {
-                _filter._inputVideoFormat.hdrType = 1;
+        if (Environment::GetInstance().IsAdmissionControlEnabled()) {
+            AVSF_AVS_API->propSetInt(frameProps, FRAME_PROP_NAME_NUM_DROPPED_FRAMES, inputSampleInfo.numDroppedFramesBefore, PROPAPPENDMODE_REPLACE);
+        }
 
-                if (const std::optional<const BYTE *> optHdrCll = hdrSideData->GetHDRContentLightLevelData()) {
-                    _filter._inputVideoFormat.hdrLuminance = reinterpret_cast<const MediaSideDataHDRContentLightLevel *>(*optHdrCll)->MaxCLL;
-                } else {
-                    _filter._inputVideoFormat.hdrLuminance = static_cast<int>(reinterpret_cast<const MediaSideDataHDR *>(*optHdr)->max_display_mastering_luminance);
-                }
-            }
+        if (Environment::GetInstance().IsDuplicateFrameDetectionEnabled()) {
+            AVSF_AVS_API->propSetInt(frameProps, FRAME_PROP_NAME_DUPLICATE_FRAME, isDuplicate, PROPAPPENDMODE_REPLACE);
         }
     }
 
@@ -116,29 +209,21 @@ auto FrameHandler::AddInputSample(IMediaSample *inputSample) -> HRESULT {
         const std::unique_lock uniqueSourceLock(_sourceMutex);
 
         _sourceFrames.emplace(std::piecewise_construct,
-                              std::forward_as_tuple(_nextSourceFrameNb),
-                              std::forward_as_tuple(frame, inputSampleStartTime, _filter.m_pInput->SampleProps()->dwTypeSpecificFlags, std::move(hdrSideData)));
-        Environment::GetInstance().Log(L"Store source frame: %6d at %10lld ~ %10lld duration(literal) %10lld max_requested %6d extra_buffer %6d",
-                                       _nextSourceFrameNb,
-                                       inputSampleStartTime,
-                                       inputSampleStopTime,
-                                       inputSampleStopTime - inputSampleStartTime,
-                                       _maxRequestedFrameNb.load(),
-                                       _extraSrcBuffer);
-        _nextSourceFrameNb += 1;
-    }
+                              std::forward_as_tuple(inputSampleInfo.frameNb),
+                              std::forward_as_tuple(frame, inputSampleInfo.startTime, inputSampleInfo.stopTime, inputSampleInfo.typeSpecificFlags, std::move(inputSampleInfo.hdrSideData)));
+        Environment::GetInstance().Log(L"Store source frame: %6d", inputSampleInfo.frameNb);
 
-    // delay activating the main frameserver until we have enough pre-buffered frames in store
-    if (_nextSourceFrameNb == Environment::GetInstance().GetInitialSrcBuffer()) {
-        MainFrameServer::GetInstance().ReloadScript(_filter.m_pInput->CurrentMediaType(), true);
+        SpillSourceFrames(_maxRequestedFrameNb, _maxRequestedFrameNb, _maxRequestedFrameNb);
     }
 
     _newSourceFrameCv.notify_all();
-
-    return S_OK;
 }
 
-auto FrameHandler::GetSourceFrame(int frameNb) -> PVideoFrame {
+/**
+ * Returns nullptr if the frame is drained or bad, which the source clip replaces with a dummy frame from its own environment.
+ */
+auto FrameHandler::GetSourceFrame(int frameNb, int sourcePastFrames) -> PVideoFrame {
+    frameNb -= _sourceFrameNbBase;
     Environment::GetInstance().Log(L"Get source frame: frameNb %6d input queue size %2zd", frameNb, _sourceFrames.size());
 
     std::shared_lock sharedSourceLock(_sourceMutex);
@@ -157,6 +242,12 @@ auto FrameHandler::GetSourceFrame(int frameNb) -> PVideoFrame {
         return iter != _sourceFrames.end();
     });
 
+    if (!_isFlushing && iter->second.spillSlot) {
+        // paging the frame back in modifies the source frames
+        sharedSourceLock.unlock();
+        return RefillSourceFrame(frameNb, sourcePastFrames);
+    }
+
     if (_isFlushing || iter->second.frame == nullptr) {
         if (_isFlushing) {
             Environment::GetInstance().Log(L"Drain for frame %6d", frameNb);
@@ -164,13 +255,114 @@ auto FrameHandler::GetSourceFrame(int frameNb) -> PVideoFrame {
             Environment::GetInstance().Log(L"Bad frame %6d", frameNb);
         }
 
-        return MainFrameServer::GetInstance().CreateSourceDummyFrame();
+        return nullptr;
     }
 
     Environment::GetInstance().Log(L"Return source frame %6d", frameNb);
     return iter->second.frame;
 }
 
+auto FrameHandler::RefillSourceFrame(int frameNb, int sourcePastFrames) -> PVideoFrame {
+    // the frame is paged in to the environment of the main frameserver
+    const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+    const std::unique_lock uniqueSourceLock(_sourceMutex);
+
+    // the frame could be refilled or garbage collected by others in the meantime
+    const auto iter = _sourceFrames.lower_bound(frameNb);
+    if (iter == _sourceFrames.end() || (iter->second.spillSlot && !PageInSourceFrame(iter->second))) {
+        Environment::GetInstance().Log(L"Bad frame %6d", frameNb);
+        return nullptr;
+    }
+
+    Environment::GetInstance().Log(L"Return refilled source frame %6d", frameNb);
+    const PVideoFrame frame = iter->second.frame;
+
+    // the frame just paged in and the past window the script reads with it would otherwise be the first to be spilled again
+    SpillSourceFrames(_maxRequestedFrameNb, iter->first - sourcePastFrames, iter->first);
+    return frame;
+}
+
+auto FrameHandler::PageOutSourceFrame(SourceFrameInfo &sourceFrame) -> bool {
+    const PVideoFrame frame = sourceFrame.frame;
+    if (frame == nullptr) {
+        return false;
+    }
+
+    const std::array srcSlices { frame->GetReadPtr(PLANAR_Y), frame->GetReadPtr(PLANAR_U), frame->GetReadPtr(PLANAR_V) };
+    const std::array srcStrides { frame->GetPitch(PLANAR_Y), frame->GetPitch(PLANAR_U), frame->GetPitch(PLANAR_V) };
+    const std::array rowSizes { frame->GetRowSize(PLANAR_Y), frame->GetRowSize(PLANAR_U), frame->GetRowSize(PLANAR_V) };
+    const std::array heights { frame->GetHeight(PLANAR_Y), frame->GetHeight(PLANAR_U), frame->GetHeight(PLANAR_V) };
+    sourceFrame.spillSlot = _sourceFrameSpill.Store(srcSlices, srcStrides, rowSizes, heights);
+    if (!sourceFrame.spillSlot) {
+        return false;
+    }
+
+    PVideoFrame propsCarrier = nullptr;
+    if (FrameServerCommon::GetInstance().IsFramePropsSupported()) {
+        VideoInfo carrierVideoInfo = _filter._inputVideoFormat.videoInfo;
+        carrierVideoInfo.width = SPILLED_FRAME_CARRIER_DIMENSION;
+        carrierVideoInfo.height = SPILLED_FRAME_CARRIER_DIMENSION;
+        propsCarrier = AVSF_AVS_API->NewVideoFrame(carrierVideoInfo);
+        AVSF_AVS_API->copyFrameProps(frame, propsCarrier);
+    }
+    sourceFrame.frame = propsCarrier;
+
+    return true;
+}
+
+auto FrameHandler::PageInSourceFrame(SourceFrameInfo &sourceFrame) -> bool {
+    PVideoFrame frame = AVSF_AVS_API->NewVideoFrame(_filter._inputVideoFormat.videoInfo);
+
+    const std::array dstSlices { frame->GetWritePtr(PLANAR_Y), frame->GetWritePtr(PLANAR_U), frame->GetWritePtr(PLANAR_V) };
+    const std::array dstStrides { frame->GetPitch(PLANAR_Y), frame->GetPitch(PLANAR_U), frame->GetPitch(PLANAR_V) };
+    const std::array rowSizes { frame->GetRowSize(PLANAR_Y), frame->GetRowSize(PLANAR_U), frame->GetRowSize(PLANAR_V) };
+    const std::array heights { frame->GetHeight(PLANAR_Y), frame->GetHeight(PLANAR_U), frame->GetHeight(PLANAR_V) };
+    if (!_sourceFrameSpill.Load(*sourceFrame.spillSlot, dstSlices, dstStrides, rowSizes, heights)) {
+        return false;
+    }
+
+    if (sourceFrame.frame != nullptr) {
+        AVSF_AVS_API->copyFrameProps(sourceFrame.frame, frame);
+    }
+    sourceFrame.frame = frame;
+    sourceFrame.spillSlot.reset();
+
+    return true;
+}
+
+/**
+ * The buffered source frames carry over to a swapped script, but must not outlive the environment that allocated them.
+ * Copy them to the environment of the current main frameserver, including the carriers of the spilled frames.
+ */
+auto FrameHandler::RecreateSourceFrames() -> void {
+    const std::unique_lock uniqueSourceLock(_sourceMutex);
+
+    for (SourceFrameInfo &sourceFrame : _sourceFrames | std::views::values) {
+        if (sourceFrame.frame == nullptr) {
+            continue;
+        }
+
+        VideoInfo videoInfo = _filter._inputVideoFormat.videoInfo;
+        if (sourceFrame.spillSlot) {
+            videoInfo.width = SPILLED_FRAME_CARRIER_DIMENSION;
+            videoInfo.height = SPILLED_FRAME_CARRIER_DIMENSION;
+        }
+
+        PVideoFrame frame = AVSF_AVS_API->NewVideoFrame(videoInfo);
+        if (!sourceFrame.spillSlot) {
+            for (const int plane : { PLANAR_Y, PLANAR_U, PLANAR_V }) {
+                AVSF_AVS_API->BitBlt(frame->GetWritePtr(plane), frame->GetPitch(plane),
+                                     sourceFrame.frame->GetReadPtr(plane), sourceFrame.frame->GetPitch(plane),
+                                     sourceFrame.frame->GetRowSize(plane), sourceFrame.frame->GetHeight(plane));
+            }
+        }
+        if (FrameServerCommon::GetInstance().IsFramePropsSupported()) {
+            AVSF_AVS_API->copyFrameProps(sourceFrame.frame, frame);
+        }
+        sourceFrame.frame = frame;
+    }
+}
+
 auto FrameHandler::BeginFlush() -> void {
     Environment::GetInstance().Log(L"FrameHandler start BeginFlush()");
 
@@ -180,6 +372,13 @@ auto FrameHandler::BeginFlush() -> void {
     _isFlushing.wait(true);
     _isFlushing = true;
 
+    {
+        const std::unique_lock ingestionLock(_ingestionMutex);
+
+        _pendingInputSamples.clear();
+    }
+    _ingestionCv.notify_all();
+
     _addInputSampleCv.notify_all();
     _newSourceFrameCv.notify_all();
 
@@ -189,6 +388,20 @@ auto FrameHandler::BeginFlush() -> void {
 auto FrameHandler::EndFlush() -> void {
     Environment::GetInstance().Log(L"FrameHandler start EndFlush()");
 
+    // the frame must not outlive the script environment
+    _lastOutputFrame = nullptr;
+    _lastOutputData.clear();
+
+    // a script swap that has not happened yet is taken over by the script reload of the new segment
+    if (_isScriptSwapPending.exchange(false)) {
+        _scriptSwapFrameServer.reset();
+        MainFrameServer::GetInstance().StopScript();
+    }
+
+    if (MainFrameServer::GetInstance().IsScriptActive() && !RebaseFrameNumbers()) {
+        MainFrameServer::GetInstance().StopScript();
+    }
+
     ResetInput();
 
     _isFlushing = false;
@@ -199,9 +412,19 @@ auto FrameHandler::EndFlush() -> void {
 
 auto FrameHandler::ResetInput() -> void {
     _sourceFrames.clear();
+    _sourceFrameSpill.Clear();
 
     _nextSourceFrameNb = 0;
     _maxRequestedFrameNb = 0;
+    _lastSourceFrameStartTime = -1;
+    _lastDeliveredFrameStartTime = -1;
+    _isOverloaded = false;
+    _numConsecutiveDroppedSourceFrames = 0;
+    _numDroppedSourceFrames = 0;
+    _lastSourceFrameHash.reset();
+    _numDuplicateSourceFrames = 0;
+    _isMainScriptReady = false;
+    _initialSrcBuffer = 0;
     _notifyChangedOutputMediaType = false;
     _extraSrcBuffer = 0;
 
@@ -209,7 +432,160 @@ auto FrameHandler::ResetInput() -> void {
     _currentInputFrameRate = 0;
 }
 
-auto FrameHandler::PrepareOutputSample(ATL::CComPtr<IMediaSample> &outSample, REFERENCE_TIME startTime, REFERENCE_TIME stopTime, DWORD sourceTypeSpecificFlags) -> bool {
+/**
+ * The cached output frames are only valid for the same script file, video source and formats.
+ */
+auto FrameHandler::UpdateOutputFrameCacheIdentity() -> void {
+    _outputFrameCache.SetBudget(static_cast<size_t>(Environment::GetInstance().GetOutputFrameCacheSize()) * 1024 * 1024);
+    if (!_outputFrameCache.IsEnabled()) {
+        return;
+    }
+
+    const std::filesystem::path &scriptPath = FrameServerCommon::GetInstance().GetScriptPath();
+    std::error_code ec;
+    const std::filesystem::file_time_type scriptWriteTime = std::filesystem::last_write_time(scriptPath, ec);
+
+    size_t identity = 0;
+    const auto CombineHash = [&identity](size_t value) -> void {
+        identity ^= value + 0x9e3779b9 + (identity << 6) + (identity >> 2);
+    };
+
+    CombineHash(std::hash<std::wstring> {}(scriptPath.native()));
+    CombineHash(std::hash<std::filesystem::file_time_type::rep> {}(scriptWriteTime.time_since_epoch().count()));
+    CombineHash(std::hash<std::wstring> {}(_filter._videoSourcePath.native()));
+    CombineHash(std::hash<const void *> {}(_filter._inputVideoFormat.pixelFormat));
+    CombineHash(std::hash<const void *> {}(_filter._outputVideoFormat.pixelFormat));
+    CombineHash(std::hash<LONG> {}(_filter._outputVideoFormat.bmi.biWidth));
+    CombineHash(std::hash<LONG> {}(_filter._outputVideoFormat.bmi.biHeight));
+
+    _outputFrameCache.SetIdentity(identity);
+}
+
+/**
+ * Some AviSynth internal filter (e.g. Subtitle) can't tolerate multi-thread access, so each script environment only renders one frame at a time.
+ * With multiple environments, the following output frames are handed round-robin to the renderer threads of the environments, and collected in order.
+ */
+auto FrameHandler::RenderOutputFrame(int outputFrameNb) -> PVideoFrame {
+    const int numEnvs = MainFrameServer::GetInstance().GetNumScriptEnvironments();
+    if (numEnvs == 1) {
+        return MainFrameServer::GetInstance().GetFrame(_outputFrameNbBase + outputFrameNb);
+    }
+
+    // discard the frames of the output frames that are skipped or served from the cache
+    while (!_renderingOutputFrames.empty() && _renderingOutputFrames.front().first < outputFrameNb) {
+        _renderingOutputFrames.front().second.wait();
+        _renderingOutputFrames.pop_front();
+    }
+
+    // a reloaded script may come with a different number of environments
+    if (static_cast<int>(_outputFrameRenderers.size()) != numEnvs) {
+        DrainRenderingOutputFrames();
+        _outputFrameRenderers.clear();
+        for (int envIndex = 0; envIndex < numEnvs; ++envIndex) {
+            _outputFrameRenderers.emplace_back(std::make_unique<OutputFrameRenderer>(envIndex));
+        }
+    }
+
+    // frames in flight always have consecutive frame numbers within the number of environments, so no environment renders two frames at once
+    for (int frameNb = _renderingOutputFrames.empty() ? outputFrameNb : _renderingOutputFrames.back().first + 1; frameNb < outputFrameNb + numEnvs; ++frameNb) {
+        _renderingOutputFrames.emplace_back(frameNb, _outputFrameRenderers[frameNb % numEnvs]->Render(_outputFrameNbBase + frameNb));
+    }
+
+    const PVideoFrame outputFrame = _renderingOutputFrames.front().second.get();
+    _renderingOutputFrames.pop_front();
+    return outputFrame;
+}
+
+FrameHandler::OutputFrameRenderer::OutputFrameRenderer(int envIndex)
+    : _envIndex(envIndex)
+    , _thread(&OutputFrameRenderer::RenderProc, this) {}
+
+FrameHandler::OutputFrameRenderer::~OutputFrameRenderer() {
+    {
+        const std::unique_lock lock(_mutex);
+
+        _isStopping = true;
+    }
+    _cv.notify_all();
+
+    _thread.join();
+}
+
+auto FrameHandler::OutputFrameRenderer::Render(int scriptFrameNb) -> std::future<PVideoFrame> {
+    std::packaged_task<PVideoFrame()> task([scriptFrameNb, envIndex = _envIndex]() -> PVideoFrame {
+        return MainFrameServer::GetInstance().GetFrame(scriptFrameNb, envIndex);
+    });
+    std::future<PVideoFrame> renderingFrame = task.get_future();
+
+    {
+        const std::unique_lock lock(_mutex);
+
+        _tasks.emplace_back(std::move(task));
+    }
+    _cv.notify_one();
+
+    return renderingFrame;
+}
+
+auto FrameHandler::OutputFrameRenderer::RenderProc() -> void {
+#ifdef _DEBUG
+    SetThreadDescription(GetCurrentThread(), std::format(L"CSynthFilter Renderer {}", _envIndex).c_str());
+#endif
+
+    while (true) {
+        std::packaged_task<PVideoFrame()> task;
+
+        {
+            std::unique_lock lock(_mutex);
+
+            _cv.wait(lock, [this]() -> bool {
+                return _isStopping || !_tasks.empty();
+            });
+            if (_tasks.empty()) {
+                break;
+            }
+
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+/**
+ * The frames rendered ahead belong to the previous playback position. During flush, the source clips return immediately, so waiting is short.
+ */
+auto FrameHandler::DrainRenderingOutputFrames() -> void {
+    for (std::pair<int, std::future<PVideoFrame>> &renderingFrame : _renderingOutputFrames) {
+        renderingFrame.second.wait();
+    }
+    _renderingOutputFrames.clear();
+}
+
+/**
+ * Replace the main script between two output frames. The new script has the same output format,
+ * so the buffered source frames and the frame numbers carry over.
+ */
+auto FrameHandler::SwapScript() -> void {
+    // the frames being rendered still need the environments of the old script
+    DrainRenderingOutputFrames();
+
+    // the new script does not repeat a frame of the old environment
+    _lastOutputFrame = nullptr;
+
+    // the ingestion thread shares the previous source frame with a duplicate one, which has to be recreated before that
+    std::unique_ptr<MainFrameServer> retiredFrameServer = MainFrameServer::Replace(std::move(_scriptSwapFrameServer), [this]() -> void {
+        RecreateSourceFrames();
+    });
+    MainFrameServer::GetInstance().LinkSynthFilter(&_filter);
+    RetireMainFrameServer(std::move(retiredFrameServer));
+    UpdateOutputFrameCacheIdentity();
+
+    Environment::GetInstance().Log(L"Swap script at output frame %6d", _nextOutputFrameNb);
+}
+
+auto FrameHandler::PrepareOutputSample(ATL::CComPtr<IMediaSample> &outSample, REFERENCE_TIME startTime, REFERENCE_TIME stopTime, const SourceFrameInfo &sourceFrame) -> bool {
     if (FAILED(_filter.m_pOutput->GetDeliveryBuffer(&outSample, &startTime, &stopTime, 0))) {
         // avoid releasing the invalid pointer in case the function change it to some random invalid address
         outSample.Detach();
@@ -224,6 +600,9 @@ auto FrameHandler::PrepareOutputSample(ATL::CComPtr<IMediaSample> &outSample, RE
         _filter.m_pOutput->SetMediaType(static_cast<CMediaType *>(pmtOut));
         _filter._outputVideoFormat = Format::GetVideoFormat(*pmtOut, &MainFrameServer::GetInstance());
         _notifyChangedOutputMediaType = true;
+        _outputFrameCache.Clear();
+        _lastOutputFrame = nullptr;
+        _lastOutputData.clear();
     }
 
     if (_notifyChangedOutputMediaType) {
@@ -254,10 +633,31 @@ auto FrameHandler::PrepareOutputSample(ATL::CComPtr<IMediaSample> &outSample, RE
                 _filter._outputVideoFormat.outputBufferTemporalFlags |= (((dstBufferInfo.Protect & PAGE_WRITECOMBINE) != 0) << 2) + 0b10;
             }
 
-            // some AviSynth internal filter (e.g. Subtitle) can't tolerate multi-thread access
-            const PVideoFrame outputFrame = MainFrameServer::GetInstance().GetFrame(_nextOutputFrameNb);
+            const ATL::CComQIPtr<IMediaSample2> outSample2(outSample);
+
+            // sample times restart near 0 after every seek. Only the times within the whole stream identify a frame
+            const REFERENCE_TIME segmentStartTime = _filter._segmentStartTime;
+            const REFERENCE_TIME streamSourceStartTime = segmentStartTime + sourceFrame.startTime;
+            const REFERENCE_TIME streamOutputStartTime = segmentStartTime + startTime;
+
+            // a frame delivered before a backward seek is served from the cache without running the script again
+            if (DWORD cachedTypeSpecificFlags;
+                _outputFrameCache.IsEnabled() && _outputFrameCache.Lookup(streamSourceStartTime, streamOutputStartTime, outputBuffer, outSample->GetSize(), cachedTypeSpecificFlags)) {
+                if (AM_SAMPLE2_PROPERTIES sampleProps;
+                    outSample2 != nullptr && SUCCEEDED(outSample2->GetProperties(SAMPLE2_TYPE_SPECIFIC_FLAGS_SIZE, reinterpret_cast<BYTE *>(&sampleProps)))) {
+                    sampleProps.dwTypeSpecificFlags = cachedTypeSpecificFlags;
+                    outSample2->SetProperties(SAMPLE2_TYPE_SPECIFIC_FLAGS_SIZE, reinterpret_cast<BYTE *>(&sampleProps));
+                }
 
-            if (const ATL::CComQIPtr<IMediaSample2> outSample2(outSample); outSample2 != nullptr) {
+                Environment::GetInstance().Log(L"Output frame %6d is served from cache, total hits %6d", _nextOutputFrameNb, _outputFrameCache.GetNumHits());
+                return true;
+            }
+
+            const PVideoFrame outputFrame = RenderOutputFrame(_nextOutputFrameNb);
+
+            DWORD outputTypeSpecificFlags = 0;
+
+            if (outSample2 != nullptr) {
                 if (AM_SAMPLE2_PROPERTIES sampleProps; SUCCEEDED(outSample2->GetProperties(SAMPLE2_TYPE_SPECIFIC_FLAGS_SIZE, reinterpret_cast<BYTE *>(&sampleProps)))) {
                     if (FrameServerCommon::GetInstance().IsFramePropsSupported()) {
                         const AVSMap *frameProps = AVSF_AVS_API->getFramePropsRO(outputFrame);
@@ -278,15 +678,31 @@ auto FrameHandler::PrepareOutputSample(ATL::CComPtr<IMediaSample> &outSample, RE
                         sampleProps.dwTypeSpecificFlags = AM_VIDEO_FLAG_WEAVE;
                     }
 
-                    if (sourceTypeSpecificFlags & AM_VIDEO_FLAG_REPEAT_FIELD) {
+                    if (sourceFrame.typeSpecificFlags & AM_VIDEO_FLAG_REPEAT_FIELD) {
                         sampleProps.dwTypeSpecificFlags |= AM_VIDEO_FLAG_REPEAT_FIELD;
                     }
 
                     outSample2->SetProperties(SAMPLE2_TYPE_SPECIFIC_FLAGS_SIZE, reinterpret_cast<BYTE *>(&sampleProps));
+                    outputTypeSpecificFlags = sampleProps.dwTypeSpecificFlags;
                 }
             }
 
-            Format::WriteSample(_filter._outputVideoFormat, outputFrame, outputBuffer);
+            const bool isRepeatedOutputFrame = outputFrame == _lastOutputFrame;
+            if (isRepeatedOutputFrame && CopyRepeatedOutputSample(outputBuffer, outSample->GetSize())) {
+                Environment::GetInstance().Log(L"Output frame %6d repeats the previous frame", _nextOutputFrameNb);
+            } else {
+                Format::WriteSample(_filter._outputVideoFormat, outputFrame, outputBuffer);
+
+                // whether the next frame repeats this one is only known after rendering it, so always keep a copy of the converted data
+                KeepOutputSampleData(outputBuffer, outSample->GetActualDataLength());
+            }
+
+            _lastOutputFrame = outputFrame;
+
+            // reading back from write-combined memory is too slow to be worth caching
+            if (_outputFrameCache.IsEnabled() && (_filter._outputVideoFormat.outputBufferTemporalFlags & 0b100) == 0) {
+                _outputFrameCache.Store(streamSourceStartTime, streamOutputStartTime, outputBuffer, outSample->GetActualDataLength(), outputTypeSpecificFlags);
+            }
         } catch (AvisynthError) {
             return false;
         }
@@ -295,14 +711,63 @@ auto FrameHandler::PrepareOutputSample(ATL::CComPtr<IMediaSample> &outSample, RE
     return true;
 }
 
+auto FrameHandler::ProcessOutputFrame(const std::map<int, SourceFrameInfo>::iterator &sourceFrameIter, REFERENCE_TIME outputStartTime, REFERENCE_TIME outputStopTime, REFERENCE_TIME sourceFrameDuration) -> void {
+    if (FrameServerCommon::GetInstance().IsFramePropsSupported()) {
+        // a spilled frame could be paged back in concurrently, which replaces the frame carrying the properties
+        const std::shared_lock sharedSourceLock(_sourceMutex);
+
+        AVSMap *frameProps = AVSF_AVS_API->getFramePropsRW(sourceFrameIter->second.frame);
+        REFERENCE_TIME frameDurationNum = sourceFrameDuration;
+        REFERENCE_TIME frameDurationDen = UNITS;
+        CoprimeIntegers(frameDurationNum, frameDurationDen);
+        AVSF_AVS_API->propSetInt(frameProps, FRAME_PROP_NAME_DURATION_NUM, frameDurationNum, PROPAPPENDMODE_REPLACE);
+        AVSF_AVS_API->propSetInt(frameProps, FRAME_PROP_NAME_DURATION_DEN, frameDurationDen, PROPAPPENDMODE_REPLACE);
+    }
+
+    _currentOutputLatency = std::max(_lastSourceFrameStartTime - outputStartTime, 0LL);
+
+    Environment::GetInstance().Log(L"Processing output frame %6d for source frame %6d at %10lld ~ %10lld duration %10lld latency %10lld",
+                                   _nextOutputFrameNb,
+                                   sourceFrameIter->first,
+                                   outputStartTime,
+                                   outputStopTime,
+                                   outputStopTime - outputStartTime,
+                                   _currentOutputLatency);
+
+    RefreshOutputFrameRates(_nextOutputFrameNb);
+
+    if (ATL::CComPtr<IMediaSample> outSample;
+        !ShouldSkipLateOutputFrame(_nextOutputFrameNb, outputStopTime) && PrepareOutputSample(outSample, outputStartTime, outputStopTime, sourceFrameIter->second)) {
+        if (const ATL::CComQIPtr<IMediaSideData> sideData(outSample); sideData != nullptr) {
+            sourceFrameIter->second.hdrSideData->WriteTo(sideData);
+        }
+
+        _filter.m_pOutput->Deliver(outSample);
+        _lastDeliveredFrameStartTime = outputStartTime;
+        RefreshDeliveryFrameRates(_nextOutputFrameNb);
+
+        Environment::GetInstance().Log(L"Deliver frame %6d", _nextOutputFrameNb);
+
+        if (_nextOutputFrameNb == 0) {
+            LogTimeToFirstFrame();
+        }
+    }
+
+    _nextOutputFrameNb += 1;
+}
+
 auto FrameHandler::WorkerProc() -> void {
     const auto ResetOutput = [this]() -> void {
         _nextOutputFrameNb = 0;
+        _nextProcessSourceFrameNb = 0;
+        _predictedSourceFrameStopTime = -1;
 
         _frameRateCheckpointOutputFrameNb = 0;
         _currentOutputFrameRate = 0;
         _frameRateCheckpointDeliveryFrameNb = 0;
         _currentDeliveryFrameRate = 0;
+        _currentOutputLatency = 0;
+        _numSkippedLateFrames = 0;
     };
 
     Environment::GetInstance().Log(L"Start worker thread");
@@ -311,11 +776,14 @@ auto FrameHandler::WorkerProc() -> void {
     SetThreadDescription(GetCurrentThread(), L"CSynthFilter Worker");
 #endif
 
+    ThreadBudget::PinCurrentThread(Environment::GetInstance().GetWorkerThreadAffinity(), L"worker");
+
     ResetOutput();
     _isWorkerLatched = false;
 
     while (true) {
         if (_isFlushing) {
+            DrainRenderingOutputFrames();
             _isWorkerLatched = true;
             _isWorkerLatched.notify_all();
             _isFlushing.wait(true);
@@ -328,11 +796,19 @@ auto FrameHandler::WorkerProc() -> void {
             _isWorkerLatched = false;
         }
 
+        if (_isScriptSwapPending.exchange(false)) {
+            SwapScript();
+        }
+
         /*
          * Some video decoders set the correct start time but the wrong stop time (stop time always being start time + average frame time).
          * Therefore instead of directly using the stop time from the current sample, we use the start time of the next sample.
+         *
+         * In low latency mode, only the current sample is used. Its stop time comes from upstream or prediction, and is corrected with
+         * the start time of the next sample.
          */
 
+        const bool isLowLatency = Environment::GetInstance().IsLowLatencyEnabled();
         std::array<decltype(_sourceFrames)::iterator, NUM_SRC_FRAMES_PER_PROCESSING> processSourceFrameIters;
         std::array<REFERENCE_TIME, NUM_SRC_FRAMES_PER_PROCESSING - 1> outputFrameDurations;
 
@@ -344,27 +820,34 @@ auto FrameHandler::WorkerProc() -> void {
                     return true;
                 }
 
-                if (_nextSourceFrameNb <= Environment::GetInstance().GetInitialSrcBuffer()) {
+                if (!_isMainScriptReady) {
                     return false;
                 }
 
-                return _sourceFrames.size() >= NUM_SRC_FRAMES_PER_PROCESSING;
+                // the frames before the next one to process are kept for the declared past window of the script
+                processSourceFrameIters[0] = _sourceFrames.lower_bound(_nextProcessSourceFrameNb);
+                return std::distance(processSourceFrameIters[0], _sourceFrames.end()) >= GetNumSrcFramesPerProcessing();
             });
 
             if (_isFlushing) {
                 continue;
             }
 
-            processSourceFrameIters[0] = _sourceFrames.begin();
-
-            for (int i = 1; i < NUM_SRC_FRAMES_PER_PROCESSING; ++i) {
-                processSourceFrameIters[i] = processSourceFrameIters[i - 1];
-                ++processSourceFrameIters[i];
-
-                outputFrameDurations[i - 1] = llMulDiv(processSourceFrameIters[i]->second.startTime - processSourceFrameIters[i - 1]->second.startTime,
-                                                       MainFrameServer::GetInstance().GetScriptAvgFrameDuration(),
-                                                       MainFrameServer::GetInstance().GetSourceAvgFrameDuration(),
-                                                       0);
+            if (isLowLatency) {
+                outputFrameDurations[0] = llMulDiv(processSourceFrameIters[0]->second.stopTime - processSourceFrameIters[0]->second.startTime,
+                                                   MainFrameServer::GetInstance().GetScriptAvgFrameDuration(),
+                                                   MainFrameServer::GetInstance().GetSourceAvgFrameDuration(),
+                                                   0);
+            } else {
+                for (int i = 1; i < NUM_SRC_FRAMES_PER_PROCESSING; ++i) {
+                    processSourceFrameIters[i] = processSourceFrameIters[i - 1];
+                    ++processSourceFrameIters[i];
+
+                    outputFrameDurations[i - 1] = llMulDiv(processSourceFrameIters[i]->second.startTime - processSourceFrameIters[i - 1]->second.startTime,
+                                                           MainFrameServer::GetInstance().GetScriptAvgFrameDuration(),
+                                                           MainFrameServer::GetInstance().GetSourceAvgFrameDuration(),
+                                                           0);
+                }
             }
         }
 
@@ -372,57 +855,79 @@ auto FrameHandler::WorkerProc() -> void {
             _nextOutputFrameStartTime = processSourceFrameIters[0]->second.startTime;
         }
 
-        while (!_isFlushing) {
-            const REFERENCE_TIME outputFrameDurationBeforeEdgePortion = std::min(processSourceFrameIters[1]->second.startTime - _nextOutputFrameStartTime, outputFrameDurations[0]);
-            if (outputFrameDurationBeforeEdgePortion <= 0) {
-                Environment::GetInstance().Log(L"Frame time drift: %10lld", -outputFrameDurationBeforeEdgePortion);
-                break;
-            }
-            const REFERENCE_TIME outputFrameDurationAfterEdgePortion = outputFrameDurations[1] - llMulDiv(outputFrameDurations[1], outputFrameDurationBeforeEdgePortion, outputFrameDurations[0], 0);
+        if (isLowLatency) {
+            const SourceFrameInfo &sourceFrame = processSourceFrameIters[0]->second;
 
-            const REFERENCE_TIME outputStartTime = _nextOutputFrameStartTime;
-            REFERENCE_TIME outputStopTime = outputStartTime + outputFrameDurationBeforeEdgePortion + outputFrameDurationAfterEdgePortion;
-            if (outputStopTime < processSourceFrameIters[1]->second.startTime && outputStopTime >= processSourceFrameIters[1]->second.startTime - MAX_OUTPUT_FRAME_DURATION_PADDING) {
-                outputStopTime = processSourceFrameIters[1]->second.startTime;
-            }
-            _nextOutputFrameStartTime = outputStopTime;
-
-            if (FrameServerCommon::GetInstance().IsFramePropsSupported()) {
-                AVSMap *frameProps = AVSF_AVS_API->getFramePropsRW(processSourceFrameIters[0]->second.frame);
-                REFERENCE_TIME frameDurationNum = processSourceFrameIters[1]->second.startTime - processSourceFrameIters[0]->second.startTime;
-                REFERENCE_TIME frameDurationDen = UNITS;
-                CoprimeIntegers(frameDurationNum, frameDurationDen);
-                AVSF_AVS_API->propSetInt(frameProps, FRAME_PROP_NAME_DURATION_NUM, frameDurationNum, PROPAPPENDMODE_REPLACE);
-                AVSF_AVS_API->propSetInt(frameProps, FRAME_PROP_NAME_DURATION_DEN, frameDurationDen, PROPAPPENDMODE_REPLACE);
+            // the predicted stop time of the previous source frame is now known to be off, shift the following output frames accordingly
+            if (_predictedSourceFrameStopTime >= 0 && sourceFrame.startTime != _predictedSourceFrameStopTime) {
+                Environment::GetInstance().Log(L"Correct frame time drift: %10lld", sourceFrame.startTime - _predictedSourceFrameStopTime);
+                _nextOutputFrameStartTime += sourceFrame.startTime - _predictedSourceFrameStopTime;
             }
+            _predictedSourceFrameStopTime = sourceFrame.stopTime;
 
-            Environment::GetInstance().Log(L"Processing output frame %6d for source frame %6d at %10lld ~ %10lld duration %10lld",
-                                           _nextOutputFrameNb,
-                                           processSourceFrameIters[0]->first,
-                                           outputStartTime,
-                                           outputStopTime,
-                                           outputStopTime - outputStartTime);
-
-            RefreshOutputFrameRates(_nextOutputFrameNb);
+            while (!_isFlushing && _nextOutputFrameStartTime < sourceFrame.stopTime && outputFrameDurations[0] > 0) {
+                const REFERENCE_TIME outputStartTime = _nextOutputFrameStartTime;
+                REFERENCE_TIME outputStopTime = outputStartTime + outputFrameDurations[0];
+                if (outputStopTime < sourceFrame.stopTime && outputStopTime >= sourceFrame.stopTime - MAX_OUTPUT_FRAME_DURATION_PADDING) {
+                    outputStopTime = sourceFrame.stopTime;
+                }
+                _nextOutputFrameStartTime = outputStopTime;
 
-            if (ATL::CComPtr<IMediaSample> outSample; PrepareOutputSample(outSample, outputStartTime, outputStopTime, processSourceFrameIters[0]->second.typeSpecificFlags)) {
-                if (const ATL::CComQIPtr<IMediaSideData> sideData(outSample); sideData != nullptr) {
-                    processSourceFrameIters[0]->second.hdrSideData->WriteTo(sideData);
+                ProcessOutputFrame(processSourceFrameIters[0], outputStartTime, outputStopTime, sourceFrame.stopTime - sourceFrame.startTime);
+            }
+        } else {
+            while (!_isFlushing) {
+                const REFERENCE_TIME outputFrameDurationBeforeEdgePortion = std::min(processSourceFrameIters[1]->second.startTime - _nextOutputFrameStartTime, outputFrameDurations[0]);
+                if (outputFrameDurationBeforeEdgePortion <= 0) {
+                    Environment::GetInstance().Log(L"Frame time drift: %10lld", -outputFrameDurationBeforeEdgePortion);
+                    break;
                 }
+                const REFERENCE_TIME outputFrameDurationAfterEdgePortion = outputFrameDurations[1] - llMulDiv(outputFrameDurations[1], outputFrameDurationBeforeEdgePortion, outputFrameDurations[0], 0);
 
-                _filter.m_pOutput->Deliver(outSample);
-                RefreshDeliveryFrameRates(_nextOutputFrameNb);
+                const REFERENCE_TIME outputStartTime = _nextOutputFrameStartTime;
+                REFERENCE_TIME outputStopTime = outputStartTime + outputFrameDurationBeforeEdgePortion + outputFrameDurationAfterEdgePortion;
+                if (outputStopTime < processSourceFrameIters[1]->second.startTime && outputStopTime >= processSourceFrameIters[1]->second.startTime - MAX_OUTPUT_FRAME_DURATION_PADDING) {
+                    outputStopTime = processSourceFrameIters[1]->second.startTime;
+                }
+                _nextOutputFrameStartTime = outputStopTime;
 
-                Environment::GetInstance().Log(L"Deliver frame %6d", _nextOutputFrameNb);
+                ProcessOutputFrame(processSourceFrameIters[0], outputStartTime, outputStopTime, processSourceFrameIters[1]->second.startTime - processSourceFrameIters[0]->second.startTime);
             }
-
-            _nextOutputFrameNb += 1;
         }
 
+        _nextProcessSourceFrameNb = processSourceFrameIters[0]->first + 1;
         GarbageCollect(processSourceFrameIters[0]->first);
     }
 
     Environment::GetInstance().Log(L"Stop worker thread");
 }
 
+auto FrameHandler::GetNumSrcFramesPerProcessing() -> int {
+    return Environment::GetInstance().IsLowLatencyEnabled() ? 1 : NUM_SRC_FRAMES_PER_PROCESSING;
+}
+
+auto FrameHandler::GetInputFrameDuration() const -> REFERENCE_TIME {
+    // the upstream is free to propose a media type without frame rate
+    if (const VideoInfo &inputVideoInfo = _filter._inputVideoFormat.videoInfo; inputVideoInfo.fps_numerator > 0 && inputVideoInfo.fps_denominator > 0) {
+        return llMulDiv(inputVideoInfo.fps_denominator, UNITS, inputVideoInfo.fps_numerator, 0);
+    }
+
+    return DEFAULT_AVG_TIME_PER_FRAME;
+}
+
+auto FrameHandler::GetInitialSrcBuffer() -> int {
+    // in low latency mode, the script starts as soon as the first source frame arrives
+    if (Environment::GetInstance().IsLowLatencyEnabled()) {
+        return 1;
+    }
+
+    // pre-buffer exactly the lookahead that the script declares
+    const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+    if (MainFrameServer::GetInstance().IsSourceWindowDeclared()) {
+        return NUM_SRC_FRAMES_PER_PROCESSING + MainFrameServer::GetInstance().GetSourceFutureFrames();
+    }
+
+    return Environment::GetInstance().GetInitialSrcBuffer();
+}
+
 }
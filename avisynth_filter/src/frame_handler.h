@@ -2,12 +2,16 @@
 
 #pragma once
 
+#include "format.h"
 #include "hdr.h"
+#include "output_frame_cache.h"
+#include "source_frame_spill.h"
 
 
 namespace SynthFilter {
 
 class CSynthFilter;
+class MainFrameServer;
 
 class FrameHandler {
 public:
@@ -17,7 +21,7 @@ public:
     DISABLE_COPYING(FrameHandler)
 
     auto AddInputSample(IMediaSample *inputSample) -> HRESULT;
-    auto GetSourceFrame(int frameNb) -> PVideoFrame;
+    auto GetSourceFrame(int frameNb, int sourcePastFrames) -> PVideoFrame;
     auto BeginFlush() -> void;
     auto EndFlush() -> void;
     auto StartWorker() -> void;
@@ -29,22 +33,97 @@ public:
     constexpr auto GetCurrentInputFrameRate() const -> int { return _currentInputFrameRate; }
     constexpr auto GetCurrentOutputFrameRate() const -> int { return _currentOutputFrameRate; }
     constexpr auto GetCurrentDeliveryFrameRate() const -> int { return _currentDeliveryFrameRate; }
+    constexpr auto GetCurrentOutputLatency() const -> REFERENCE_TIME { return _currentOutputLatency; }
+    constexpr auto GetNumDroppedSourceFrames() const -> int { return _numDroppedSourceFrames; }
+    constexpr auto GetNumSkippedLateFrames() const -> int { return _numSkippedLateFrames; }
+    constexpr auto GetNumDuplicateSourceFrames() const -> int { return _numDuplicateSourceFrames; }
+    constexpr auto GetNumSpilledSourceFrames() const -> int { return _sourceFrameSpill.GetNumSpills(); }
+    constexpr auto GetNumRefilledSourceFrames() const -> int { return _sourceFrameSpill.GetNumRefills(); }
 
 private:
     struct SourceFrameInfo {
         PVideoFrame frame;
         REFERENCE_TIME startTime;
+        REFERENCE_TIME stopTime;
         DWORD typeSpecificFlags;
         std::unique_ptr<HDRSideData> hdrSideData;
+
+        // while spilled, the frame only carries the frame properties
+        std::optional<int> spillSlot;
+    };
+
+    struct InputSampleInfo {
+        ATL::CComPtr<IMediaSample> sample;
+        int frameNb;
+        REFERENCE_TIME startTime;
+        REFERENCE_TIME stopTime;
+        DWORD typeSpecificFlags;
+        int numDroppedFramesBefore;
+        Format::VideoFormat videoFormat;
+        std::unique_ptr<HDRSideData> hdrSideData;
+    };
+
+    /**
+     * Renders the output frames of one script environment, always on the same thread.
+     */
+    class OutputFrameRenderer {
+    public:
+        explicit OutputFrameRenderer(int envIndex);
+        ~OutputFrameRenderer();
+
+        DISABLE_COPYING(OutputFrameRenderer)
+
+        auto Render(int scriptFrameNb) -> std::future<PVideoFrame>;
+
+    private:
+        auto RenderProc() -> void;
+
+        int _envIndex;
+        std::deque<std::packaged_task<PVideoFrame()>> _tasks;
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        bool _isStopping = false;
+        std::thread _thread;
     };
 
     static auto RefreshFrameRatesTemplate(int sampleNb, int &checkpointSampleNb, std::chrono::steady_clock::time_point &checkpointTime, int &currentFrameRate) -> void;
+    static auto GetNumSrcFramesPerProcessing() -> int;
+    static auto GetInitialSrcBuffer() -> int;
 
     auto ResetInput() -> void;
-    auto PrepareOutputSample(ATL::CComPtr<IMediaSample> &outSample, REFERENCE_TIME startTime, REFERENCE_TIME stopTime, DWORD sourceTypeSpecificFlags) -> bool;
+    auto IngestionProc() -> void;
+    auto QueueInputSample(InputSampleInfo &&inputSampleInfo) -> bool;
+    auto ReadHDRSideData(IMediaSample *inputSample) -> std::unique_ptr<HDRSideData>;
+    auto IngestInputSample(InputSampleInfo &inputSampleInfo) -> void;
+    auto UpdateIngestionQueueDepth() -> void;
+    auto WaitForIngestionIdle() -> void;
+    auto ShouldDropInputSample() -> bool;
+    auto ShouldSkipLateOutputFrame(int outputFrameNb, REFERENCE_TIME outputStopTime) -> bool;
+    auto StartScriptReload() -> void;
+    auto WaitForScriptReload() -> bool;
+    auto RebaseFrameNumbers() -> bool;
+    auto DetectDuplicateSourceFrame(const BYTE *sampleBuffer, long sampleSize) -> bool;
+    auto CopyRepeatedOutputSample(BYTE *outputBuffer, long outputBufferSize) const -> bool;
+    auto KeepOutputSampleData(const BYTE *outputBuffer, long dataLength) -> bool;
+    auto LogTimeToFirstFrame() const -> void;
+    auto GetInputFrameDuration() const -> REFERENCE_TIME;
+    auto UpdateOutputFrameCacheIdentity() -> void;
+    auto RenderOutputFrame(int outputFrameNb) -> PVideoFrame;
+    auto DrainRenderingOutputFrames() -> void;
+    auto PrepareOutputSample(ATL::CComPtr<IMediaSample> &outSample, REFERENCE_TIME startTime, REFERENCE_TIME stopTime, const SourceFrameInfo &sourceFrame) -> bool;
+    auto ProcessOutputFrame(const std::map<int, SourceFrameInfo>::iterator &sourceFrameIter, REFERENCE_TIME outputStartTime, REFERENCE_TIME outputStopTime, REFERENCE_TIME sourceFrameDuration) -> void;
     auto WorkerProc() -> void;
+    auto PageOutSourceFrame(SourceFrameInfo &sourceFrame) -> bool;
+    auto PageInSourceFrame(SourceFrameInfo &sourceFrame) -> bool;
+    auto RefillSourceFrame(int frameNb, int sourcePastFrames) -> PVideoFrame;
+    auto RecreateSourceFrames() -> void;
+    auto SpillSourceFrames(int hotFrameNb, int pinnedFirstFrameNb, int pinnedLastFrameNb) -> void;
     auto GarbageCollect(int srcFrameNb) -> void;
     auto ChangeOutputFormat() -> bool;
+    auto PrepareScriptSwap() -> bool;
+    auto AbandonScriptSwapProbe() -> void;
+    auto SwapScript() -> void;
+    auto RetireMainFrameServer(std::unique_ptr<MainFrameServer> retiredFrameServer) -> void;
     auto UpdateExtraSrcBuffer() -> void;
     auto RefreshInputFrameRates(int frameNb) -> void;
     auto RefreshOutputFrameRates(int frameNb) -> void;
@@ -55,6 +134,8 @@ private:
     CSynthFilter &_filter;
 
     std::map<int, SourceFrameInfo> _sourceFrames;
+    OutputFrameCache _outputFrameCache;
+    SourceFrameSpill _sourceFrameSpill;
 
     mutable std::shared_mutex _sourceMutex;
 
@@ -63,12 +144,48 @@ private:
 
     int _nextSourceFrameNb;
     std::atomic<int> _maxRequestedFrameNb;
+    int _nextProcessSourceFrameNb;
     int _nextOutputFrameNb;
     REFERENCE_TIME _nextOutputFrameStartTime;
+    std::atomic<REFERENCE_TIME> _lastSourceFrameStartTime;
+    REFERENCE_TIME _predictedSourceFrameStopTime;
+    bool _isMainScriptReady;
+    int _initialSrcBuffer;
     bool _notifyChangedOutputMediaType;
+    PVideoFrame _lastOutputFrame;
+    std::vector<BYTE> _lastOutputData;
+
+    // output frames being rendered by the script environments, in the order of their frame numbers
+    std::deque<std::pair<int, std::future<PVideoFrame>>> _renderingOutputFrames;
+    std::vector<std::unique_ptr<OutputFrameRenderer>> _outputFrameRenderers;
     int _extraSrcBuffer;
 
     std::thread _workerThread;
+    std::thread _ingestionThread;
+    std::deque<InputSampleInfo> _pendingInputSamples;
+    std::mutex _ingestionMutex;
+    std::condition_variable _ingestionCv;
+    size_t _maxPendingInputSamples = 1;
+    bool _isIngesting = false;
+    std::atomic<REFERENCE_TIME> _lastDeliveredFrameStartTime;
+    bool _isOverloaded;
+    int _numConsecutiveDroppedSourceFrames;
+    int _numDroppedSourceFrames;
+    int _numSkippedLateFrames;
+    std::optional<uint64_t> _lastSourceFrameHash;
+    int _numDuplicateSourceFrames;
+    std::shared_future<bool> _scriptReloadFuture;
+    int _sourceFrameNbBase = 0;
+    int _outputFrameNbBase = 0;
+    std::chrono::steady_clock::time_point _firstSourceFrameTime;
+
+    // a changed script with unchanged output format is evaluated on a separate main frameserver, then swapped in by the worker
+    std::future<std::unique_ptr<MainFrameServer>> _scriptSwapProbe;
+    std::vector<std::future<std::unique_ptr<MainFrameServer>>> _abandonedScriptSwapProbes;
+    std::filesystem::path _scriptSwapPath;
+    std::unique_ptr<MainFrameServer> _scriptSwapFrameServer;
+    std::future<void> _retiredFrameServerRelease;
+    std::atomic<bool> _isScriptSwapPending = false;
 
     std::atomic<bool> _isFlushing = false;
     std::atomic<bool> _isStopping = false;
@@ -83,6 +200,7 @@ private:
     int _currentInputFrameRate;
     int _currentOutputFrameRate;
     int _currentDeliveryFrameRate;
+    REFERENCE_TIME _currentOutputLatency;
 };
 
 }
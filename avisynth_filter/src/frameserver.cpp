@@ -5,6 +5,7 @@
 #include "api.h"
 #include "constants.h"
 #include "filter.h"
+#include "thread_budget.h"
 
 
 namespace {
@@ -20,7 +21,16 @@ const AVS_Linkage *AVS_linkage = nullptr;
 namespace SynthFilter {
 
 auto __cdecl Create_AvsFilterSource(AVSValue args, void *user_data, IScriptEnvironment *env) -> AVSValue {
-    return static_cast<IClip *>(user_data);
+    FrameServerBase *frameServer = static_cast<FrameServerBase *>(user_data);
+
+    // scripts may declare how many source frames around the current one they read, e.g. AvsFilterSource(past=3, future=3)
+    if (args[0].Defined() || args[1].Defined()) {
+        frameServer->_isSourceWindowDeclared = true;
+        frameServer->_sourcePastFrames = std::max(args[0].AsInt(0), frameServer->_sourcePastFrames);
+        frameServer->_sourceFutureFrames = std::max(args[1].AsInt(0), frameServer->_sourceFutureFrames);
+    }
+
+    return frameServer->_sourceClip;
 }
 
 auto __cdecl Create_AvsFilterDisconnect(AVSValue args, void *user_data, IScriptEnvironment *env) -> AVSValue {
@@ -43,6 +53,19 @@ FrameServerCommon::FrameServerCommon() {
     _versionString = env->Invoke("Eval", AVSValue("VersionString()")).AsString();
     Environment::GetInstance().Log(L"AviSynth version: %hs", GetVersionString().data());
 
+    // plugins are autoloaded from the directories registered by the AviSynth installers
+    std::vector<std::filesystem::path> pluginDirs;
+    for (const HKEY rootKey : { HKEY_LOCAL_MACHINE, HKEY_CURRENT_USER }) {
+        for (const WCHAR *valueName : { L"plugindir2_5", L"plugindir+" }) {
+            std::array<WCHAR, MAX_PATH> buffer;
+            DWORD bufferSize = static_cast<DWORD>(buffer.size() * sizeof(WCHAR));
+            if (RegGetValueW(rootKey, L"SOFTWARE\\AviSynth", valueName, RRF_RT_REG_SZ, nullptr, buffer.data(), &bufferSize) == ERROR_SUCCESS) {
+                pluginDirs.emplace_back(buffer.data());
+            }
+        }
+    }
+    _frameServerHash = ScriptProbeKey::HashFrameServer(GetVersionString(), pluginDirs);
+
     try {
         // AVS+ 3.6 is interface version 8
         env->CheckVersion(8);
@@ -79,9 +102,9 @@ auto FrameServerCommon::CreateEnv() -> IScriptEnvironment * {
 }
 
 auto FrameServerBase::CreateAndSetupEnv() -> void {
-    _sourceClip = new SourceClip();
+    _sourceClip = new SourceClip(*this, _sourceVideoInfo);
     _env = FrameServerCommon::CreateEnv();
-    _env->AddFunction(AVS_FUNC_NAME_SOURCE_CLIP, "", Create_AvsFilterSource, _sourceClip);
+    _env->AddFunction(AVS_FUNC_NAME_SOURCE_CLIP, "[past]i[future]i", Create_AvsFilterSource, this);
     _env->AddFunction(AVS_FUNC_NAME_DISCONNECT, "", Create_AvsFilterDisconnect, nullptr);
 }
 
@@ -91,12 +114,19 @@ auto FrameServerBase::CreateAndSetupEnv() -> void {
 auto FrameServerBase::ReloadScript(const AM_MEDIA_TYPE &mediaType, bool ignoreDisconnect) -> bool {
     StopScript();
 
-    const VideoInfo &sourceVideoInfo = Format::GetVideoFormat(mediaType, this).videoInfo;
-    FrameServerCommon::GetInstance()._sourceVideoInfo = sourceVideoInfo;
+    _sourceVideoInfo = Format::GetVideoFormat(mediaType, this).videoInfo;
 
     _errorString.clear();
+    _isSourceWindowDeclared = false;
+    _sourcePastFrames = 0;
+    _sourceFutureFrames = 0;
     AVSValue invokeResult;
 
+    // a prefetcher set up by the script raises the threads of the filter chain during its evaluation
+    if (FrameServerCommon::GetInstance().IsFramePropsSupported()) {
+        _filterChainThreadsBeforeScript = _env->GetEnvProperty(AEP_FILTERCHAIN_THREADS);
+    }
+
     if (!FrameServerCommon::GetInstance()._scriptPath.empty()) {
         const std::string utf8Filename = ConvertWideToUtf8(FrameServerCommon::GetInstance()._scriptPath.native());
         const std::array<AVSValue, 2> args { utf8Filename.c_str(), true };
@@ -130,6 +160,9 @@ auto FrameServerBase::ReloadScript(const AM_MEDIA_TYPE &mediaType, bool ignoreDi
 
     _scriptClip = invokeResult.AsClip();
     Environment::GetInstance().Log(L"New script clip: %p", _scriptClip);
+    if (_isSourceWindowDeclared) {
+        Environment::GetInstance().Log(L"Script declares source window: past %d future %d", _sourcePastFrames, _sourceFutureFrames);
+    }
     _scriptVideoInfo = _scriptClip->GetVideoInfo();
     _scriptAvgFrameDuration = llMulDiv(_scriptVideoInfo.fps_denominator, UNITS, _scriptVideoInfo.fps_numerator, 0);
 
@@ -143,6 +176,111 @@ auto FrameServerBase::StopScript() -> void {
     }
 }
 
+/**
+ * The buffered source frames are allocated by the main environment, whose frame registry owns their memory.
+ * Other environments read copies in their own frames, which their caches in front of the source clip keep for the source window.
+ */
+auto FrameServerBase::AdoptSourceFrame(const PVideoFrame &sourceFrame) const -> PVideoFrame {
+    if (_env == AVSF_AVS_API) {
+        return sourceFrame;
+    }
+
+    PVideoFrame frame = _env->NewVideoFrame(_sourceVideoInfo);
+    for (const int plane : { PLANAR_Y, PLANAR_U, PLANAR_V }) {
+        _env->BitBlt(frame->GetWritePtr(plane), frame->GetPitch(plane),
+                     sourceFrame->GetReadPtr(plane), sourceFrame->GetPitch(plane),
+                     sourceFrame->GetRowSize(plane), sourceFrame->GetHeight(plane));
+    }
+    if (FrameServerCommon::GetInstance().IsFramePropsSupported()) {
+        _env->copyFrameProps(sourceFrame, frame);
+    }
+
+    return frame;
+}
+
+auto FrameServerBase::LinkFrameHandler(FrameHandler *frameHandler) const -> void {
+    reinterpret_cast<SourceClip *>(static_cast<void *>(_sourceClip))->SetFrameHandler(frameHandler);
+}
+
+/**
+ * Wrap the script clip in Prefetch() when the script does not set up a prefetcher by itself.
+ * The frameserver's share of the thread budget is split between all script environments.
+ */
+auto FrameServerBase::InjectPrefetch() -> void {
+    // GetEnvProperty() is only part of IScriptEnvironment since interface version 8, the same as frame properties
+    if (!Environment::GetInstance().IsAutoPrefetchEnabled() || !FrameServerCommon::GetInstance().IsFramePropsSupported()
+        || !_errorString.empty() || _scriptClip == _sourceClip) {
+        return;
+    }
+
+    // check on every reload, since the reloaded script may set up a prefetcher even if the previous one did not
+    if (const int filterChainThreads = _env->GetEnvProperty(AEP_FILTERCHAIN_THREADS);
+        filterChainThreads > _filterChainThreadsBeforeScript || filterChainThreads > std::max(_numInjectedPrefetchThreads, 1)) {
+        Environment::GetInstance().Log(L"Script sets up its own prefetcher");
+        return;
+    }
+
+    if (_scriptClip->SetCacheHints(CACHE_GET_MTMODE, 0) == MT_SERIALIZED) {
+        Environment::GetInstance().Log(L"Script clip is not thread-safe, keep it serial");
+        return;
+    }
+
+    const int numPrefetchThreads = ThreadBudget::GetFrameServerThreads() / Environment::GetInstance().GetNumScriptEnvironments();
+    if (numPrefetchThreads < 2) {
+        return;
+    }
+
+    const std::array<AVSValue, 2> args { _scriptClip, numPrefetchThreads };
+
+    try {
+        _scriptClip = _env->Invoke("Prefetch", AVSValue(args.data(), static_cast<int>(args.size()))).AsClip();
+        _numInjectedPrefetchThreads = numPrefetchThreads;
+        Environment::GetInstance().Log(L"Inject prefetcher with %d threads: %p", numPrefetchThreads, _scriptClip);
+    } catch (AvisynthError &err) {
+        Environment::GetInstance().Log(L"Unable to inject prefetcher: %hs", err.msg);
+    }
+}
+
+ParallelFrameServer::ParallelFrameServer(const CSynthFilter *filter, FrameHandler *frameHandler) {
+    CreateAndSetupEnv();
+    _env->AddFunction(AVS_FUNC_NAME_GET_SOURCE_PATH, "", Create_AvsFilterGetSourcePath, &_filter);
+    LinkSynthFilter(filter, frameHandler);
+}
+
+ParallelFrameServer::~ParallelFrameServer() {
+    StopScript();
+    _sourceDummyFrame = nullptr;
+    _env->DeleteScriptEnvironment();
+}
+
+auto ParallelFrameServer::ReloadScript(const AM_MEDIA_TYPE &mediaType) -> bool {
+    _sourceDummyFrame = _env->NewVideoFrame(Format::GetVideoFormat(mediaType, this).videoInfo);
+
+    if (__super::ReloadScript(mediaType, true)) {
+        InjectPrefetch();
+        return true;
+    }
+
+    return false;
+}
+
+auto ParallelFrameServer::LinkSynthFilter(const CSynthFilter *filter, FrameHandler *frameHandler) -> void {
+    _filter = filter;
+    LinkFrameHandler(frameHandler);
+}
+
+auto ParallelFrameServer::GetFrame(int frameNb) const -> PVideoFrame {
+    return _scriptClip->GetFrame(frameNb, _env);
+}
+
+/**
+ * Cap the frame cache of the environment. 0 keeps the current limit.
+ * Returns the effective limit in MiB.
+ */
+auto ParallelFrameServer::SetCacheLimit(int cacheLimit) const -> int {
+    return _env->SetMemoryMax(cacheLimit);
+}
+
 MainFrameServer::MainFrameServer() {
     CreateAndSetupEnv();
     _env->AddFunction(AVS_FUNC_NAME_GET_SOURCE_PATH, "", Create_AvsFilterGetSourcePath, &_filter);
@@ -150,52 +288,111 @@ MainFrameServer::MainFrameServer() {
 
 MainFrameServer::~MainFrameServer() {
     StopScript();
+    _parallelFrameServers.clear();
+    _sourceDummyFrame = nullptr;
     _env->DeleteScriptEnvironment();
 }
 
 auto MainFrameServer::ReloadScript(const AM_MEDIA_TYPE &mediaType, bool ignoreDisconnect) -> bool {
     Environment::GetInstance().Log(L"ReloadScript from main frameserver");
 
-    if (__super::ReloadScript(mediaType, ignoreDisconnect)) {
-        const VideoInfo &sourceVideoInfo = FrameServerCommon::GetInstance()._sourceVideoInfo;
-        _sourceAvgFrameRate = static_cast<int>(llMulDiv(sourceVideoInfo.fps_numerator, FRAME_RATE_SCALE_FACTOR, sourceVideoInfo.fps_denominator, 0));
-        _sourceAvgFrameDuration = llMulDiv(sourceVideoInfo.fps_denominator, UNITS, sourceVideoInfo.fps_numerator, 0);
+    // the script may drain source frames during evaluation, so the shared dummy frame has to exist before that
+    _sourceDummyFrame = _env->NewVideoFrame(Format::GetVideoFormat(mediaType, this).videoInfo);
 
-        return true;
+    // errors of the script itself are rendered into the script clip, so what is left are failures of the environments, e.g. while showing that error
+    try {
+        if (!__super::ReloadScript(mediaType, ignoreDisconnect)) {
+            return false;
+        }
+
+        InjectPrefetch();
+
+        _sourceAvgFrameRate = static_cast<int>(llMulDiv(_sourceVideoInfo.fps_numerator, FRAME_RATE_SCALE_FACTOR, _sourceVideoInfo.fps_denominator, 0));
+        _sourceAvgFrameDuration = llMulDiv(_sourceVideoInfo.fps_denominator, UNITS, _sourceVideoInfo.fps_numerator, 0);
+
+        // every additional environment renders its own share of the output frames with a separate copy of the script
+        _parallelFrameServers.resize(Environment::GetInstance().GetNumScriptEnvironments() - 1);
+        for (std::unique_ptr<ParallelFrameServer> &parallelFrameServer : _parallelFrameServers) {
+            if (parallelFrameServer == nullptr) {
+                parallelFrameServer = std::make_unique<ParallelFrameServer>(_filter, _frameHandler);
+            }
+            parallelFrameServer->ReloadScript(mediaType);
+        }
+
+        // the environments share the cache limit
+        const int envCacheLimit = DivideRoundUp(CalculateCacheLimit(mediaType), GetNumScriptEnvironments());
+        _cacheLimit = _env->SetMemoryMax(envCacheLimit);
+        for (const std::unique_ptr<ParallelFrameServer> &parallelFrameServer : _parallelFrameServers) {
+            _cacheLimit += parallelFrameServer->SetCacheLimit(envCacheLimit);
+        }
+        Environment::GetInstance().Log(L"Frameserver cache limit: %d MiB", _cacheLimit);
+    } catch (AvisynthError &err) {
+        _errorString = err.msg;
+        Environment::GetInstance().Log(L"Unable to evaluate main script: %hs", err.msg);
+        return false;
     }
 
-    return false;
+    return true;
+}
+
+auto MainFrameServer::StopScript() -> void {
+    __super::StopScript();
+
+    for (const std::unique_ptr<ParallelFrameServer> &parallelFrameServer : _parallelFrameServers) {
+        parallelFrameServer->StopScript();
+    }
 }
 
 auto MainFrameServer::GetFrame(int frameNb) const -> PVideoFrame {
     return _scriptClip->GetFrame(frameNb, _env);
 }
 
-auto MainFrameServer::CreateSourceDummyFrame() const -> PVideoFrame {
-    return _env->NewVideoFrame(FrameServerCommon::GetInstance().GetSourceVideoInfo());
+auto MainFrameServer::GetFrame(int frameNb, int envIndex) const -> PVideoFrame {
+    return envIndex == 0 ? GetFrame(frameNb) : _parallelFrameServers[envIndex - 1]->GetFrame(frameNb);
 }
 
 auto MainFrameServer::LinkSynthFilter(const CSynthFilter *filter) -> void {
     _filter = filter;
-    reinterpret_cast<SourceClip *>(static_cast<void *>(_sourceClip))->SetFrameHandler(filter->frameHandler.get());
+
+    // a frameserver evaluated for a script swap reads dummy source frames until it is published,
+    // since the buffered source frames belong to the environment that it replaces
+    _frameHandler = this == &GetInstance() ? filter->frameHandler.get() : nullptr;
+    LinkFrameHandler(_frameHandler);
+
+    // warm environments still point to the filter that released them
+    for (const std::unique_ptr<ParallelFrameServer> &parallelFrameServer : _parallelFrameServers) {
+        parallelFrameServer->LinkSynthFilter(filter, _frameHandler);
+    }
 }
 
 auto AuxFrameServer::ReloadScript(const AM_MEDIA_TYPE &mediaType, bool ignoreDisconnect) -> bool {
+    _probeCache.Load(FrameServerCommon::GetInstance().GetVersionString());
+
+    const std::optional<ScriptProbeKey> optProbeKey = ScriptProbeKey::Create(FrameServerCommon::GetInstance()._scriptPath, FrameServerCommon::GetInstance()._frameServerHash, mediaType, ignoreDisconnect, AVS_FUNC_NAME_GET_SOURCE_PATH);
+    if (const std::optional<ProbeResult> optProbeResult = optProbeKey ? _probeCache.Find<ProbeResult>(*optProbeKey) : std::nullopt) {
+        Environment::GetInstance().Log(L"Reuse probe result from auxiliary frameserver");
+
+        _sourceVideoInfo = Format::GetVideoFormat(mediaType, this).videoInfo;
+        _scriptVideoInfo = optProbeResult->scriptVideoInfo;
+        _scriptAvgFrameDuration = optProbeResult->scriptAvgFrameDuration;
+        return optProbeResult->isAccepted;
+    }
+
     Environment::GetInstance().Log(L"ReloadScript from auxiliary frameserver");
 
     CreateAndSetupEnv();
 
-    if (__super::ReloadScript(mediaType, ignoreDisconnect)) {
-        StopScript();
+    const bool isAccepted = __super::ReloadScript(mediaType, ignoreDisconnect);
+    StopScript();
 
-        // AviSynth+ prefetchers are only destroyed when the environment is deleted
-        // just stopping the script clip is not enough
-        _env->DeleteScriptEnvironment();
+    // AviSynth+ prefetchers are only destroyed when the environment is deleted
+    // just stopping the script clip is not enough
+    _env->DeleteScriptEnvironment();
 
-        return true;
+    if (optProbeKey) {
+        _probeCache.Store(*optProbeKey, ProbeResult { isAccepted, _scriptVideoInfo, _scriptAvgFrameDuration });
     }
-
-    return false;
+    return isAccepted;
 }
 
 }
@@ -4,6 +4,7 @@
 
 #include "environment.h"
 #include "format.h"
+#include "script_probe.h"
 #include "singleton.h"
 #include "source_clip.h"
 
@@ -24,7 +25,6 @@ public:
     auto SetScriptPath(const std::filesystem::path &scriptPath) -> void;
     constexpr auto GetVersionString() const -> std::string_view { return _versionString == nullptr ? "unknown AviSynth version" : _versionString; }
     constexpr auto IsFramePropsSupported() const -> bool { return _isFramePropsSupported; }
-    constexpr auto GetSourceVideoInfo() const -> const VideoInfo & { return _sourceVideoInfo; }
     constexpr auto GetScriptPath() const -> const std::filesystem::path & { return _scriptPath; }
 
 private:
@@ -32,24 +32,69 @@ private:
 
     const char *_versionString = nullptr;
     bool _isFramePropsSupported = false;
+
+    // identifies the frameserver version together with its plugins for the script probe results
+    uint64_t _frameServerHash = 0;
     std::filesystem::path _scriptPath = Environment::GetInstance().GetScriptPath();
-    VideoInfo _sourceVideoInfo {};
 };
 
 class FrameServerBase {
+    friend auto __cdecl Create_AvsFilterSource(AVSValue args, void *user_data, IScriptEnvironment *env) -> AVSValue;
+
+public:
+    constexpr auto IsSourceWindowDeclared() const -> bool { return _isSourceWindowDeclared; }
+    constexpr auto GetSourcePastFrames() const -> int { return _sourcePastFrames; }
+    constexpr auto GetSourceFutureFrames() const -> int { return _sourceFutureFrames; }
+    auto GetSourceDummyFrame() const -> PVideoFrame { return _sourceDummyFrame; }
+    auto AdoptSourceFrame(const PVideoFrame &sourceFrame) const -> PVideoFrame;
+
 protected:
     CTOR_WITHOUT_COPYING(FrameServerBase)
 
     auto CreateAndSetupEnv() -> void;
     auto ReloadScript(const AM_MEDIA_TYPE &mediaType, bool ignoreDisconnect) -> bool;
     auto StopScript() -> void;
+    auto LinkFrameHandler(FrameHandler *frameHandler) const -> void;
+    auto InjectPrefetch() -> void;
 
     IScriptEnvironment *_env = nullptr;
+    VideoInfo _sourceVideoInfo {};
     PClip _sourceClip = nullptr;
     PClip _scriptClip = nullptr;
     VideoInfo _scriptVideoInfo {};
     REFERENCE_TIME _scriptAvgFrameDuration = 0;
     std::string _errorString;
+    bool _isSourceWindowDeclared = false;
+    int _sourcePastFrames = 0;
+    int _sourceFutureFrames = 0;
+
+    // returned for the drained source frames, allocated by the environment that reads them
+    PVideoFrame _sourceDummyFrame = nullptr;
+
+    // prefetchers live as long as the environment, so remember the threads we injected by previous reloads
+    int _numInjectedPrefetchThreads = 0;
+    int _filterChainThreadsBeforeScript = 1;
+};
+
+/**
+ * Additional script environment for frame parallel rendering of scripts that are not thread-safe.
+ * Each environment evaluates its own copy of the script, with its own source clip reading from the shared frame handler.
+ */
+class ParallelFrameServer : public FrameServerBase {
+public:
+    ParallelFrameServer(const CSynthFilter *filter, FrameHandler *frameHandler);
+    ~ParallelFrameServer();
+
+    DISABLE_COPYING(ParallelFrameServer)
+
+    auto ReloadScript(const AM_MEDIA_TYPE &mediaType) -> bool;
+    using FrameServerBase::StopScript;
+    auto LinkSynthFilter(const CSynthFilter *filter, FrameHandler *frameHandler) -> void;
+    auto GetFrame(int frameNb) const -> PVideoFrame;
+    auto SetCacheLimit(int cacheLimit) const -> int;
+
+private:
+    const CSynthFilter *_filter = nullptr;
 };
 
 class MainFrameServer
@@ -62,20 +107,30 @@ public:
     DISABLE_COPYING(MainFrameServer)
 
     auto ReloadScript(const AM_MEDIA_TYPE &mediaType, bool ignoreDisconnect) -> bool;
-    using FrameServerBase::StopScript;
+    auto StopScript() -> void;
     auto GetFrame(int frameNb) const -> PVideoFrame;
-    auto CreateSourceDummyFrame() const -> PVideoFrame;
+    auto GetFrame(int frameNb, int envIndex) const -> PVideoFrame;
+    auto GetNumScriptEnvironments() const -> int { return static_cast<int>(_parallelFrameServers.size()) + 1; }
+    auto IsScriptActive() const -> bool;
     auto LinkSynthFilter(const CSynthFilter *filter) -> void;
     constexpr auto GetEnv() const -> IScriptEnvironment * { return _env; }
     constexpr auto GetSourceAvgFrameDuration() const -> REFERENCE_TIME { return _sourceAvgFrameDuration; }
     constexpr auto GetSourceAvgFrameRate() const -> int { return _sourceAvgFrameRate; }
     constexpr auto GetScriptAvgFrameDuration() const -> REFERENCE_TIME { return _scriptAvgFrameDuration; }
+    constexpr auto GetCacheLimit() const -> int { return _cacheLimit; }
     auto GetErrorString() const -> std::optional<std::string>;
 
 private:
+    auto CalculateCacheLimit(const AM_MEDIA_TYPE &mediaType) const -> int;
+
     REFERENCE_TIME _sourceAvgFrameDuration = 0;
     int _sourceAvgFrameRate = 0;
+    int _cacheLimit = 0;
     const CSynthFilter *_filter;
+
+    // the frame handler whose source frames the script reads, only linked while this is the published instance
+    FrameHandler *_frameHandler = nullptr;
+    std::vector<std::unique_ptr<ParallelFrameServer>> _parallelFrameServers;
 };
 
 class AuxFrameServer
@@ -87,6 +142,17 @@ public:
     auto ReloadScript(const AM_MEDIA_TYPE &mediaType, bool ignoreDisconnect) -> bool;
     auto GenerateMediaType(const Format::PixelFormat &pixelFormat, const AM_MEDIA_TYPE *templateMediaType) const -> CMediaType;
     constexpr auto GetScriptPixelType() const -> int { return _scriptVideoInfo.pixel_type; }
+
+private:
+    struct ProbeResult {
+        bool isAccepted;
+        VideoInfo scriptVideoInfo;
+        REFERENCE_TIME scriptAvgFrameDuration;
+    };
+
+    // creating an environment autoloads all plugins, so probing the same media type again should not
+    // shared by the auxiliary frameservers that probe concurrently
+    static inline ScriptProbeCache _probeCache;
 };
 
 #define AVSF_AVS_API MainFrameServer::GetInstance().GetEnv()
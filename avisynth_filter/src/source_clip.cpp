@@ -7,6 +7,10 @@
 
 namespace SynthFilter {
 
+SourceClip::SourceClip(const FrameServerBase &frameServer, const VideoInfo &videoInfo)
+    : _frameServer(frameServer)
+    , _videoInfo(videoInfo) {}
+
 auto SourceClip::SetFrameHandler(FrameHandler *frameHandler) -> void {
     _frameHandler = frameHandler;
 }
@@ -17,11 +21,26 @@ auto SourceClip::GetFrame(int frameNb, IScriptEnvironment *env) -> PVideoFrame {
         return env->NewVideoFrame(GetVideoInfo());
     }
 
-    return _frameHandler->GetSourceFrame(frameNb);
+    if (const PVideoFrame frame = _frameHandler->GetSourceFrame(frameNb, _frameServer.GetSourcePastFrames())) {
+        return _frameServer.AdoptSourceFrame(frame);
+    }
+
+    return _frameServer.GetSourceDummyFrame();
 }
 
-auto SourceClip::GetVideoInfo() -> const VideoInfo & {
-    return FrameServerCommon::GetInstance().GetSourceVideoInfo();
+auto SourceClip::SetCacheHints(int cachehints, int frame_range) -> int {
+    switch (cachehints) {
+    case CACHE_GET_MTMODE:
+        return MT_NICE_FILTER;
+    case CACHE_GET_WINDOW:
+        // the frame handler already keeps the declared window of source frames, tell the cache to not hold more than that
+        if (_frameServer.IsSourceWindowDeclared()) {
+            return _frameServer.GetSourcePastFrames() + _frameServer.GetSourceFutureFrames() + 1;
+        }
+        return 0;
+    default:
+        return 0;
+    }
 }
 
 }
@@ -7,17 +7,26 @@
 
 namespace SynthFilter {
 
+class FrameServerBase;
+
 class SourceClip : public IClip {
 public:
+    SourceClip(const FrameServerBase &frameServer, const VideoInfo &videoInfo);
+
     auto SetFrameHandler(FrameHandler *frameHandler) -> void;
 
     auto __stdcall GetFrame(int frameNb, IScriptEnvironment *env) -> PVideoFrame override;
-    auto __stdcall GetVideoInfo() -> const VideoInfo & override;
+    constexpr auto __stdcall GetVideoInfo() -> const VideoInfo & override { return _videoInfo; }
     constexpr auto __stdcall GetParity(int frameNb) -> bool override { return true; }
     constexpr auto __stdcall GetAudio(void *buf, int64_t start, int64_t count, IScriptEnvironment *env) -> void override {}
-    constexpr auto __stdcall SetCacheHints(int cachehints, int frame_range) -> int override { return cachehints == CACHE_GET_MTMODE ? MT_NICE_FILTER : 0; }
+    auto __stdcall SetCacheHints(int cachehints, int frame_range) -> int override;
 
 private:
+    // the frameserver whose environment reads this clip, which may not be the current main frameserver during a script swap
+    const FrameServerBase &_frameServer;
+
+    // owned by the frameserver, which may run its script concurrently with other frameservers of different source formats
+    const VideoInfo &_videoInfo;
     FrameHandler *_frameHandler = nullptr;
 };
 
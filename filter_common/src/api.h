@@ -21,7 +21,7 @@ enum class AvsState {
 
 namespace {
 
-constexpr const int API_VERSION                           = 1;
+constexpr const int API_VERSION                           = 2;
 constexpr const char *API_WND_CLASS_NAME                  = "AvsFilterRemoteControlClass";
 constexpr const char *API_CSV_DELIMITER                   = ";";
 
@@ -139,5 +139,12 @@ constexpr const ULONG_PTR API_MSG_GET_AVS_SOURCE_FILE     = 402;
  */
 constexpr const ULONG_PTR API_MSG_SET_AVS_SOURCE_FILE     = 403;
 
+/**
+ * input : none
+ * output: effective limit of the FrameServer frame cache, in MiB
+ * note  : since API version 2
+ */
+constexpr const ULONG_PTR API_MSG_GET_AVS_CACHE_LIMIT     = 404;
+
 }
 }
@@ -56,6 +56,93 @@ constexpr const WCHAR *UNAVAILABLE_SOURCE_PATH                = L"N/A";
  */
 constexpr const int NUM_FRAMES_FOR_INFINITE_STREAM            = 10810800;
 
+/*
+ * When the script is kept alive across flushes, frame numbers continue beyond the previous segment plus this gap,
+ * so that neither the frames cached by the script nor the temporal neighbors it requests overlap with the old ones.
+ */
+constexpr const int WARM_FLUSH_FRAME_NB_GAP                   = 1000;
+
+/*
+ * With admission control, the stream is considered overloaded once the delivered frames fall behind the stream clock by
+ * the enter threshold, and recovers when the lag shrinks below the exit threshold.
+ * Source frames are then dropped before conversion, but never more than the maximum number in a row.
+ * Unit is 100ns.
+ */
+constexpr const REFERENCE_TIME OVERLOAD_ENTER_DELIVERY_LAG    = 2000000;
+constexpr const REFERENCE_TIME OVERLOAD_EXIT_DELIVERY_LAG     = 500000;
+constexpr const int MAX_CONSECUTIVE_DROPPED_SRC_FRAMES        = 1;
+
+/*
+ * With late frame skipping, an output frame is skipped if its stop time plus this margin is already behind the stream time.
+ * Unit is millisecond.
+ */
+constexpr const int LATE_FRAME_SKIP_MARGIN                    = 0;
+
+/*
+ * Budget of the cache of recently delivered output frames, which serves short backward seeks without running the script.
+ * 0 disables the cache.
+ * Unit is MiB.
+ */
+constexpr const int OUTPUT_FRAME_CACHE_SIZE                   = 0;
+
+/*
+ * Memory budget of the buffered source frames. Frames beyond the budget are spilled into a scratch file and paged back in when requested.
+ * 0 keeps all source frames in memory.
+ * Unit is MiB.
+ */
+constexpr const int SOURCE_FRAME_SPILL_BUDGET                 = 0;
+
+/*
+ * Memory target of the buffered source frames together with the frameserver's frame cache. The frameserver cache is capped at
+ * the rest of the target after the source buffer, but never below the script's temporal window for every frameserver thread.
+ * 0 leaves the cache to the frameserver's own heuristics.
+ * Unit is MiB.
+ */
+constexpr const int MEMORY_TARGET                             = 0;
+
+/*
+ * Number of independent AviSynth script environments that render output frames in parallel.
+ * Each environment evaluates its own copy of the script, which scales scripts that are not thread-safe at the cost of memory.
+ */
+constexpr const int SCRIPT_ENVIRONMENTS                       = 1;
+constexpr const int MAX_SCRIPT_ENVIRONMENTS                   = 16;
+
+/*
+ * Number of logical cores shared by the threads of the filter and of the frameserver, i.e. AviSynth+ prefetcher or VapourSynth core.
+ * 0 uses all logical cores.
+ */
+constexpr const int THREAD_BUDGET                             = 0;
+
+/*
+ * Threads of the filter itself that stay busy while the script renders, i.e. the worker and the ingestion thread.
+ * The frameserver gets the rest of the thread budget.
+ */
+constexpr const int NUM_FILTER_THREADS                        = 2;
+
+/*
+ * Number of input pixel formats whose scripts are probed at the same time during pin connection, each on its own auxiliary frameserver.
+ */
+constexpr const int PARALLEL_PROBES                           = 1;
+constexpr const int MAX_PARALLEL_PROBES                       = 16;
+
+/*
+ * Seconds to keep the initialized frameservers alive after the last filter instance is destroyed, so that the next instance can reuse them.
+ * 0 destroys them together with the last instance.
+ */
+constexpr const int FRAME_SERVER_IDLE_TIMEOUT                 = 0;
+
+// extension of the file in the user's local application data folder that persists the script probe results
+constexpr const WCHAR *PROBE_CACHE_FILE_EXTENSION             = L"probe";
+
+// number of results kept in the probe cache file. The least recently stored ones are dropped first
+constexpr const int MAX_PERSISTED_PROBE_RESULTS               = 256;
+
+// serializes the player processes rewriting the probe cache file
+constexpr const WCHAR *PROBE_CACHE_MUTEX_NAME                 = L"Local\\" WIDEN(FILTER_FILENAME_BASE) L"_probe_cache";
+
+// width and height of the minimal frame that carries the frame properties of a spilled source frame
+constexpr const int SPILLED_FRAME_CARRIER_DIMENSION           = 16;
+
 /*
  * align stride of input media type to this number so that LAV Filters can enable its "direct" mode
  * for better performance.
@@ -72,6 +159,8 @@ constexpr const char *FRAME_PROP_NAME_DURATION_DEN            = "_DurationDen";
 constexpr const char *FRAME_PROP_NAME_FIELD_BASED             = "_FieldBased";
 constexpr const char *FRAME_PROP_NAME_SOURCE_FRAME_NB         = "AVSF_SourceFrameNb";
 constexpr const char *FRAME_PROP_NAME_TYPE_SPECIFIC_FLAGS     = "AVSF_TypeSpecificFlags";
+constexpr const char *FRAME_PROP_NAME_NUM_DROPPED_FRAMES      = "AVSF_NumDroppedFrames";
+constexpr const char *FRAME_PROP_NAME_DUPLICATE_FRAME         = "AVSF_DuplicateFrame";
 
 constexpr const WCHAR *REGISTRY_KEY_NAME_PREFIX               = L"Software\\AviSynthFilter\\";
 constexpr const WCHAR *SETTING_NAME_SCRIPT_FILE               = L"ScriptFile";
@@ -83,6 +172,25 @@ constexpr const WCHAR *SETTING_NAME_MIN_EXTRA_SRC_BUFFER      = L"MinExtraSrcBuf
 constexpr const WCHAR *SETTING_NAME_MAX_EXTRA_SRC_BUFFER      = L"MaxExtraSrcBuffer";
 constexpr const WCHAR *SETTING_NAME_EXTRA_SRC_BUFFER_DEC_STEP = L"ExtraSrcBufferDecStep";
 constexpr const WCHAR *SETTING_NAME_EXTRA_SRC_BUFFER_INC_STEP = L"ExtraSrcBufferIncStep";
+constexpr const WCHAR *SETTING_NAME_LOW_LATENCY               = L"LowLatency";
+constexpr const WCHAR *SETTING_NAME_WARM_FLUSH                = L"WarmFlush";
+constexpr const WCHAR *SETTING_NAME_ADMISSION_CONTROL         = L"AdmissionControl";
+constexpr const WCHAR *SETTING_NAME_LATE_FRAME_SKIP           = L"LateFrameSkip";
+constexpr const WCHAR *SETTING_NAME_LATE_FRAME_SKIP_MARGIN    = L"LateFrameSkipMargin";
+constexpr const WCHAR *SETTING_NAME_MAX_IN_FLIGHT_OUTPUT_FRAMES = L"MaxInFlightOutputFrames";
+constexpr const WCHAR *SETTING_NAME_OUTPUT_FRAME_CACHE_SIZE   = L"OutputFrameCacheSize";
+constexpr const WCHAR *SETTING_NAME_SOURCE_FRAME_SPILL_BUDGET = L"SourceFrameSpillBudget";
+constexpr const WCHAR *SETTING_NAME_SCRIPT_ENVIRONMENTS       = L"ScriptEnvironments";
+constexpr const WCHAR *SETTING_NAME_AUTO_PREFETCH             = L"AutoPrefetch";
+constexpr const WCHAR *SETTING_NAME_THREAD_BUDGET             = L"ThreadBudget";
+constexpr const WCHAR *SETTING_NAME_MEMORY_TARGET             = L"MemoryTarget";
+constexpr const WCHAR *SETTING_NAME_PERSISTENT_PROBE_CACHE    = L"PersistentProbeCache";
+constexpr const WCHAR *SETTING_NAME_PARALLEL_PROBES           = L"ParallelProbes";
+constexpr const WCHAR *SETTING_NAME_FRAME_SERVER_IDLE_TIMEOUT = L"FrameServerIdleTimeout";
+constexpr const WCHAR *SETTING_NAME_INGESTION_THREAD_AFFINITY = L"IngestionThreadAffinity";
+constexpr const WCHAR *SETTING_NAME_WORKER_THREAD_AFFINITY    = L"WorkerThreadAffinity";
+constexpr const WCHAR *SETTING_NAME_DUPLICATE_FRAME_DETECTION = L"DuplicateFrameDetection";
+constexpr const WCHAR *SETTING_NAME_DUPLICATE_FRAME_REUSE     = L"DuplicateFrameReuse";
 
 constexpr const int REMOTE_CONTROL_SMTO_TIMEOUT_MS            = 1000;
 
@@ -46,6 +46,21 @@ Environment::Environment()
                 &Format::PixelFormat::name);
 
             Log(L"Loading process: %ls", processName.c_str());
+            Log(L"Low latency mode: %d", _isLowLatencyEnabled);
+            Log(L"Warm flush: %d", _isWarmFlushEnabled);
+            Log(L"Admission control: %d", _isAdmissionControlEnabled);
+            Log(L"Late frame skip: %d margin %d ms", _isLateFrameSkipEnabled, _lateFrameSkipMargin);
+            Log(L"Max in-flight output frames: %d", _maxInFlightOutputFrames);
+            Log(L"Output frame cache size: %d MiB", _outputFrameCacheSize);
+            Log(L"Source frame spill budget: %d MiB", _sourceFrameSpillBudget);
+            Log(L"Script environments: %d", _numScriptEnvironments);
+            Log(L"Auto prefetch: %d", _isAutoPrefetchEnabled);
+            Log(L"Thread budget: %d ingestion affinity %#zx worker affinity %#zx", _threadBudget, _ingestionThreadAffinity, _workerThreadAffinity);
+            Log(L"Memory target: %d MiB", _memoryTarget);
+            Log(L"Persistent probe cache: %d", _isPersistentProbeCacheEnabled);
+            Log(L"Parallel probes: %d", _numParallelProbes);
+            Log(L"Frameserver idle timeout: %d s", _frameServerIdleTimeout);
+            Log(L"Duplicate frame detection: %d reuse %d", _isDuplicateFrameDetectionEnabled, _isDuplicateFrameReuseEnabled);
         }
     }
 
@@ -118,6 +133,27 @@ auto Environment::LoadSettingsFromIni() -> void {
     _extraSrcBufferDecStep = _ini.GetLongValue(L"", SETTING_NAME_EXTRA_SRC_BUFFER_DEC_STEP, EXTRA_SRC_BUFFER_DEC_STEP);
     _extraSrcBufferIncStep = _ini.GetLongValue(L"", SETTING_NAME_EXTRA_SRC_BUFFER_INC_STEP, EXTRA_SRC_BUFFER_INC_STEP);
     ValidateExtraSrcBufferValues();
+
+    _isLowLatencyEnabled = _ini.GetBoolValue(L"", SETTING_NAME_LOW_LATENCY, false);
+    _isWarmFlushEnabled = _ini.GetBoolValue(L"", SETTING_NAME_WARM_FLUSH, false);
+    _isAdmissionControlEnabled = _ini.GetBoolValue(L"", SETTING_NAME_ADMISSION_CONTROL, false);
+    _isLateFrameSkipEnabled = _ini.GetBoolValue(L"", SETTING_NAME_LATE_FRAME_SKIP, false);
+    _lateFrameSkipMargin = _ini.GetLongValue(L"", SETTING_NAME_LATE_FRAME_SKIP_MARGIN, LATE_FRAME_SKIP_MARGIN);
+    _maxInFlightOutputFrames = std::max(_ini.GetLongValue(L"", SETTING_NAME_MAX_IN_FLIGHT_OUTPUT_FRAMES, 0), 0L);
+    _outputFrameCacheSize = std::max(_ini.GetLongValue(L"", SETTING_NAME_OUTPUT_FRAME_CACHE_SIZE, OUTPUT_FRAME_CACHE_SIZE), 0L);
+    _sourceFrameSpillBudget = std::max(_ini.GetLongValue(L"", SETTING_NAME_SOURCE_FRAME_SPILL_BUDGET, SOURCE_FRAME_SPILL_BUDGET), 0L);
+    _numScriptEnvironments = std::clamp(_ini.GetLongValue(L"", SETTING_NAME_SCRIPT_ENVIRONMENTS, SCRIPT_ENVIRONMENTS), 1L, static_cast<long>(MAX_SCRIPT_ENVIRONMENTS));
+    _isAutoPrefetchEnabled = _ini.GetBoolValue(L"", SETTING_NAME_AUTO_PREFETCH, false);
+    _threadBudget = std::max(_ini.GetLongValue(L"", SETTING_NAME_THREAD_BUDGET, THREAD_BUDGET), 0L);
+    _memoryTarget = std::max(_ini.GetLongValue(L"", SETTING_NAME_MEMORY_TARGET, MEMORY_TARGET), 0L);
+    _isPersistentProbeCacheEnabled = _ini.GetBoolValue(L"", SETTING_NAME_PERSISTENT_PROBE_CACHE, false);
+    _numParallelProbes = std::clamp(_ini.GetLongValue(L"", SETTING_NAME_PARALLEL_PROBES, PARALLEL_PROBES), 1L, static_cast<long>(MAX_PARALLEL_PROBES));
+    _frameServerIdleTimeout = std::max(_ini.GetLongValue(L"", SETTING_NAME_FRAME_SERVER_IDLE_TIMEOUT, FRAME_SERVER_IDLE_TIMEOUT), 0L);
+    // affinity masks cover up to 64 logical processors, more than a long holds
+    _ingestionThreadAffinity = static_cast<DWORD_PTR>(std::wcstoull(_ini.GetValue(L"", SETTING_NAME_INGESTION_THREAD_AFFINITY, L"0"), nullptr, 0));
+    _workerThreadAffinity = static_cast<DWORD_PTR>(std::wcstoull(_ini.GetValue(L"", SETTING_NAME_WORKER_THREAD_AFFINITY, L"0"), nullptr, 0));
+    _isDuplicateFrameDetectionEnabled = _ini.GetBoolValue(L"", SETTING_NAME_DUPLICATE_FRAME_DETECTION, false);
+    _isDuplicateFrameReuseEnabled = _isDuplicateFrameDetectionEnabled && _ini.GetBoolValue(L"", SETTING_NAME_DUPLICATE_FRAME_REUSE, false);
 }
 
 auto Environment::LoadSettingsFromRegistry() -> void {
@@ -139,6 +175,26 @@ auto Environment::LoadSettingsFromRegistry() -> void {
     _extraSrcBufferDecStep = _registry.ReadNumber(SETTING_NAME_EXTRA_SRC_BUFFER_DEC_STEP, EXTRA_SRC_BUFFER_DEC_STEP);
     _extraSrcBufferIncStep = _registry.ReadNumber(SETTING_NAME_EXTRA_SRC_BUFFER_INC_STEP, EXTRA_SRC_BUFFER_INC_STEP);
     ValidateExtraSrcBufferValues();
+
+    _isLowLatencyEnabled = _registry.ReadNumber(SETTING_NAME_LOW_LATENCY, 0) != 0;
+    _isWarmFlushEnabled = _registry.ReadNumber(SETTING_NAME_WARM_FLUSH, 0) != 0;
+    _isAdmissionControlEnabled = _registry.ReadNumber(SETTING_NAME_ADMISSION_CONTROL, 0) != 0;
+    _isLateFrameSkipEnabled = _registry.ReadNumber(SETTING_NAME_LATE_FRAME_SKIP, 0) != 0;
+    _lateFrameSkipMargin = _registry.ReadNumber(SETTING_NAME_LATE_FRAME_SKIP_MARGIN, LATE_FRAME_SKIP_MARGIN);
+    _maxInFlightOutputFrames = std::max(static_cast<int>(_registry.ReadNumber(SETTING_NAME_MAX_IN_FLIGHT_OUTPUT_FRAMES, 0)), 0);
+    _outputFrameCacheSize = std::max(static_cast<int>(_registry.ReadNumber(SETTING_NAME_OUTPUT_FRAME_CACHE_SIZE, OUTPUT_FRAME_CACHE_SIZE)), 0);
+    _sourceFrameSpillBudget = std::max(static_cast<int>(_registry.ReadNumber(SETTING_NAME_SOURCE_FRAME_SPILL_BUDGET, SOURCE_FRAME_SPILL_BUDGET)), 0);
+    _numScriptEnvironments = std::clamp(static_cast<int>(_registry.ReadNumber(SETTING_NAME_SCRIPT_ENVIRONMENTS, SCRIPT_ENVIRONMENTS)), 1, MAX_SCRIPT_ENVIRONMENTS);
+    _isAutoPrefetchEnabled = _registry.ReadNumber(SETTING_NAME_AUTO_PREFETCH, 0) != 0;
+    _threadBudget = std::max(static_cast<int>(_registry.ReadNumber(SETTING_NAME_THREAD_BUDGET, THREAD_BUDGET)), 0);
+    _memoryTarget = std::max(static_cast<int>(_registry.ReadNumber(SETTING_NAME_MEMORY_TARGET, MEMORY_TARGET)), 0);
+    _isPersistentProbeCacheEnabled = _registry.ReadNumber(SETTING_NAME_PERSISTENT_PROBE_CACHE, 0) != 0;
+    _numParallelProbes = std::clamp(static_cast<int>(_registry.ReadNumber(SETTING_NAME_PARALLEL_PROBES, PARALLEL_PROBES)), 1, MAX_PARALLEL_PROBES);
+    _frameServerIdleTimeout = std::max(static_cast<int>(_registry.ReadNumber(SETTING_NAME_FRAME_SERVER_IDLE_TIMEOUT, FRAME_SERVER_IDLE_TIMEOUT)), 0);
+    _ingestionThreadAffinity = static_cast<DWORD_PTR>(_registry.ReadQword(SETTING_NAME_INGESTION_THREAD_AFFINITY, 0));
+    _workerThreadAffinity = static_cast<DWORD_PTR>(_registry.ReadQword(SETTING_NAME_WORKER_THREAD_AFFINITY, 0));
+    _isDuplicateFrameDetectionEnabled = _registry.ReadNumber(SETTING_NAME_DUPLICATE_FRAME_DETECTION, 0) != 0;
+    _isDuplicateFrameReuseEnabled = _isDuplicateFrameDetectionEnabled && _registry.ReadNumber(SETTING_NAME_DUPLICATE_FRAME_REUSE, 0) != 0;
 }
 
 auto Environment::ValidateExtraSrcBufferValues() -> void {
@@ -45,6 +45,25 @@ public:
     constexpr auto GetMaxExtraSrcBuffer() const -> int { return _maxExtraSrcBuffer; }
     constexpr auto GetExtraSrcBufferDecStep() const -> int { return _extraSrcBufferDecStep; }
     constexpr auto GetExtraSrcBufferIncStep() const -> int { return _extraSrcBufferIncStep; }
+    constexpr auto IsLowLatencyEnabled() const -> bool { return _isLowLatencyEnabled; }
+    constexpr auto IsWarmFlushEnabled() const -> bool { return _isWarmFlushEnabled; }
+    constexpr auto IsAdmissionControlEnabled() const -> bool { return _isAdmissionControlEnabled; }
+    constexpr auto IsLateFrameSkipEnabled() const -> bool { return _isLateFrameSkipEnabled; }
+    constexpr auto GetLateFrameSkipMargin() const -> int { return _lateFrameSkipMargin; }
+    constexpr auto GetMaxInFlightOutputFrames() const -> int { return _maxInFlightOutputFrames; }
+    constexpr auto GetOutputFrameCacheSize() const -> int { return _outputFrameCacheSize; }
+    constexpr auto GetSourceFrameSpillBudget() const -> int { return _sourceFrameSpillBudget; }
+    constexpr auto GetNumScriptEnvironments() const -> int { return _numScriptEnvironments; }
+    constexpr auto IsAutoPrefetchEnabled() const -> bool { return _isAutoPrefetchEnabled; }
+    constexpr auto GetThreadBudget() const -> int { return _threadBudget; }
+    constexpr auto GetMemoryTarget() const -> int { return _memoryTarget; }
+    constexpr auto IsPersistentProbeCacheEnabled() const -> bool { return _isPersistentProbeCacheEnabled; }
+    constexpr auto GetNumParallelProbes() const -> int { return _numParallelProbes; }
+    constexpr auto GetFrameServerIdleTimeout() const -> int { return _frameServerIdleTimeout; }
+    constexpr auto GetIngestionThreadAffinity() const -> DWORD_PTR { return _ingestionThreadAffinity; }
+    constexpr auto GetWorkerThreadAffinity() const -> DWORD_PTR { return _workerThreadAffinity; }
+    constexpr auto IsDuplicateFrameDetectionEnabled() const -> bool { return _isDuplicateFrameDetectionEnabled; }
+    constexpr auto IsDuplicateFrameReuseEnabled() const -> bool { return _isDuplicateFrameReuseEnabled; }
 
 private:
     auto LoadSettingsFromIni() -> void;
@@ -67,6 +86,25 @@ private:
     int _maxExtraSrcBuffer;
     int _extraSrcBufferDecStep;
     int _extraSrcBufferIncStep;
+    bool _isLowLatencyEnabled = false;
+    bool _isWarmFlushEnabled = false;
+    bool _isAdmissionControlEnabled = false;
+    bool _isLateFrameSkipEnabled = false;
+    int _lateFrameSkipMargin = LATE_FRAME_SKIP_MARGIN;
+    int _maxInFlightOutputFrames = 0;
+    int _outputFrameCacheSize = OUTPUT_FRAME_CACHE_SIZE;
+    int _sourceFrameSpillBudget = SOURCE_FRAME_SPILL_BUDGET;
+    int _numScriptEnvironments = SCRIPT_ENVIRONMENTS;
+    bool _isAutoPrefetchEnabled = false;
+    int _threadBudget = THREAD_BUDGET;
+    int _memoryTarget = MEMORY_TARGET;
+    bool _isPersistentProbeCacheEnabled = false;
+    int _numParallelProbes = PARALLEL_PROBES;
+    int _frameServerIdleTimeout = FRAME_SERVER_IDLE_TIMEOUT;
+    DWORD_PTR _ingestionThreadAffinity = 0;
+    DWORD_PTR _workerThreadAffinity = 0;
+    bool _isDuplicateFrameDetectionEnabled = false;
+    bool _isDuplicateFrameReuseEnabled = false;
 
     std::filesystem::path _logPath;
     FILE *_logFile = nullptr;
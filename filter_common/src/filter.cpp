@@ -3,6 +3,7 @@
 #include "filter.h"
 
 #include "constants.h"
+#include "frameserver_pool.h"
 #include "input_pin.h"
 #include "macros.h"
 #include "prop_settings.h"
@@ -13,14 +14,7 @@ namespace SynthFilter {
 
 CSynthFilter::CSynthFilter(LPUNKNOWN pUnk, HRESULT *phr)
     : CVideoTransformFilter(FILTER_NAME_FULL, pUnk, __uuidof(CSynthFilter)) {
-    if (_numFilterInstances == 0) {
-        Environment::Create();
-        FrameServerCommon::Create();
-        MainFrameServer::Create().LinkSynthFilter(this);
-        AuxFrameServer::Create();
-        Format::Initialize();
-    }
-    _numFilterInstances += 1;
+    FrameServerPool::Lease(this);
 
     Environment::GetInstance().Log(L"CSynthFilter(): %p", this);
 }
@@ -28,15 +22,9 @@ CSynthFilter::CSynthFilter(LPUNKNOWN pUnk, HRESULT *phr)
 CSynthFilter::~CSynthFilter() {
     Environment::GetInstance().Log(L"Destroy CSynthFilter: %p", this);
 
-    _numFilterInstances -= 1;
-    if (_numFilterInstances == 0) {
-        _remoteControl.reset();
-        frameHandler.reset();
-        AuxFrameServer::Destroy();
-        MainFrameServer::Destroy();
-        FrameServerCommon::Destroy();
-        Environment::Destroy();
-    }
+    _remoteControl.reset();
+    frameHandler.reset();
+    FrameServerPool::Release();
 }
 
 auto STDMETHODCALLTYPE CSynthFilter::NonDelegatingQueryInterface(REFIID riid, __deref_out void **ppv) -> HRESULT {
@@ -71,6 +59,8 @@ auto CSynthFilter::GetPin(int n) -> CBasePin * {
 auto CSynthFilter::CheckConnect(PIN_DIRECTION direction, IPin *pPin) -> HRESULT {
     HRESULT hr;
 
+    FrameServerPool::WaitUntilReady();
+
     if (_disconnectFilter) {
         return VFW_E_TYPE_NOT_ACCEPTED;
     }
@@ -79,6 +69,9 @@ auto CSynthFilter::CheckConnect(PIN_DIRECTION direction, IPin *pPin) -> HRESULT
         ATL::CComPtr<IEnumMediaTypes> enumTypes;
         CheckHr(pPin->EnumMediaTypes(&enumTypes));
 
+        // the first offered media type of each supported input pixel format that is not yet known to be compatible
+        std::vector<ProbeMediaType> probeMediaTypes;
+
         AM_MEDIA_TYPE *nextType;
         while (true) {
             hr = enumTypes->Next(1, &nextType, nullptr);
@@ -86,24 +79,9 @@ auto CSynthFilter::CheckConnect(PIN_DIRECTION direction, IPin *pPin) -> HRESULT
                 const std::shared_ptr<AM_MEDIA_TYPE> nextTypePtr(nextType, &DeleteMediaType);
 
                 if (const Format::PixelFormat *optInputPixelFormat = GetInputPixelFormat(nextType);
-                    optInputPixelFormat && std::ranges::find(_compatibleMediaTypes, optInputPixelFormat, &MediaTypePair::inputPixelFormat) == _compatibleMediaTypes.end()) {
-                    // invoke the script with each supported input pixel format, and observe the output frameserver format
-                    if (!AuxFrameServer::GetInstance().ReloadScript(*nextType, Environment::GetInstance().IsRemoteControlEnabled())) {
-                        Environment::GetInstance().Log(L"Disconnect filter by user request");
-                        _disconnectFilter = true;
-                        return VFW_E_TYPE_NOT_ACCEPTED;
-                    }
-
-                    // all media types that share the same frameserver format are acceptable for output pin connection
-                    const int scriptFormatId = AuxFrameServer::GetInstance().GetScriptPixelType();
-                    for (const Format::PixelFormat &frameServerPixelFormat : Format::LookupFrameServerFormatId(scriptFormatId)) {
-                        const CMediaType outputMediaType = AuxFrameServer::GetInstance().GenerateMediaType(frameServerPixelFormat, nextType);
-                        _compatibleMediaTypes.emplace_back(nextTypePtr, optInputPixelFormat, outputMediaType, MediaTypeToPixelFormat(&outputMediaType));
-                        if (std::ranges::find(_availableOutputMediaTypes, outputMediaType) == _availableOutputMediaTypes.end()) {
-                            _availableOutputMediaTypes.emplace_back(outputMediaType);
-                        }
-                        Environment::GetInstance().Log(L"Add compatible formats: input %5ls output %5ls", optInputPixelFormat->name, frameServerPixelFormat.name);
-                    }
+                    optInputPixelFormat && std::ranges::find(_compatibleMediaTypes, optInputPixelFormat, &MediaTypePair::inputPixelFormat) == _compatibleMediaTypes.end()
+                    && std::ranges::find(probeMediaTypes, optInputPixelFormat, &ProbeMediaType::inputPixelFormat) == probeMediaTypes.end()) {
+                    probeMediaTypes.emplace_back(nextTypePtr, optInputPixelFormat);
                 }
             } else if (hr == VFW_E_ENUM_OUT_OF_SYNC) {
                 CheckHr(enumTypes->Reset());
@@ -111,6 +89,49 @@ auto CSynthFilter::CheckConnect(PIN_DIRECTION direction, IPin *pPin) -> HRESULT
                 break;
             }
         }
+
+        /*
+         * Invoke the script with each supported input pixel format, and observe the output frameserver format.
+         * The probes are independent of each other, so a batch of them runs concurrently, each on its own auxiliary frameserver.
+         * The results are merged in the order of the offered media types regardless of which probe finishes first.
+         */
+        const size_t numParallelProbes = Environment::GetInstance().GetNumParallelProbes();
+        for (size_t batchStart = 0; batchStart < probeMediaTypes.size(); batchStart += numParallelProbes) {
+            const size_t batchEnd = std::min(batchStart + numParallelProbes, probeMediaTypes.size());
+
+            std::vector<std::future<std::optional<std::vector<CMediaType>>>> probeFutures;
+            for (size_t i = batchStart + 1; i < batchEnd; ++i) {
+                probeFutures.emplace_back(std::async(std::launch::async, [inputMediaType = probeMediaTypes[i].inputMediaType]() -> std::optional<std::vector<CMediaType>> {
+                    AuxFrameServer auxFrameServer;
+                    return ProbeOutputMediaTypes(auxFrameServer, *inputMediaType);
+                }));
+            }
+
+            std::vector<std::optional<std::vector<CMediaType>>> probeResults;
+            probeResults.emplace_back(ProbeOutputMediaTypes(AuxFrameServer::GetInstance(), *probeMediaTypes[batchStart].inputMediaType));
+            for (std::future<std::optional<std::vector<CMediaType>>> &probeFuture : probeFutures) {
+                probeResults.emplace_back(probeFuture.get());
+            }
+
+            for (size_t i = batchStart; i < batchEnd; ++i) {
+                const std::optional<std::vector<CMediaType>> &optOutputMediaTypes = probeResults[i - batchStart];
+                if (!optOutputMediaTypes) {
+                    Environment::GetInstance().Log(L"Disconnect filter by user request");
+                    _disconnectFilter = true;
+                    return VFW_E_TYPE_NOT_ACCEPTED;
+                }
+
+                const auto &[inputMediaType, inputPixelFormat] = probeMediaTypes[i];
+                for (const CMediaType &outputMediaType : *optOutputMediaTypes) {
+                    const Format::PixelFormat *outputPixelFormat = MediaTypeToPixelFormat(&outputMediaType);
+                    _compatibleMediaTypes.emplace_back(inputMediaType, inputPixelFormat, outputMediaType, outputPixelFormat);
+                    if (std::ranges::find(_availableOutputMediaTypes, outputMediaType) == _availableOutputMediaTypes.end()) {
+                        _availableOutputMediaTypes.emplace_back(outputMediaType);
+                    }
+                    Environment::GetInstance().Log(L"Add compatible formats: input %5ls output %5ls", inputPixelFormat->name, outputPixelFormat->name);
+                }
+            }
+        }
     }
 
     return S_OK;
@@ -129,6 +150,8 @@ auto CSynthFilter::BreakConnect(PIN_DIRECTION direction) -> HRESULT {
 auto CSynthFilter::CheckInputType(const CMediaType *mtIn) -> HRESULT {
     bool result = false;
 
+    FrameServerPool::WaitUntilReady();
+
     if (const Format::PixelFormat *optInputPixelFormat = MediaTypeToPixelFormat(mtIn); optInputPixelFormat) {
         if (!IsActive()) {
             result = std::ranges::any_of(_compatibleMediaTypes, [optInputPixelFormat](const MediaTypePair &pair) -> bool {
@@ -157,6 +180,8 @@ auto CSynthFilter::GetMediaType(int iPosition, CMediaType *pMediaType) -> HRESUL
         return E_UNEXPECTED;
     }
 
+    FrameServerPool::WaitUntilReady();
+
     if (iPosition >= static_cast<int>(_availableOutputMediaTypes.size())) {
         return VFW_S_NO_MORE_ITEMS;
     }
@@ -174,6 +199,8 @@ auto CSynthFilter::CheckTransform(const CMediaType *mtIn, const CMediaType *mtOu
 auto CSynthFilter::DecideBufferSize(IMemAllocator *pAlloc, ALLOCATOR_PROPERTIES *pProperties) -> HRESULT {
     HRESULT hr;
 
+    FrameServerPool::WaitUntilReady();
+
     pProperties->cBuffers = std::max(pProperties->cBuffers, 2L);
 
     const long newMediaSampleSize = Format::GetStrideAlignedMediaSampleSize(m_pOutput->CurrentMediaType(), Format::OUTPUT_MEDIA_SAMPLE_STRIDE_ALIGNMENT);
@@ -186,6 +213,8 @@ auto CSynthFilter::DecideBufferSize(IMemAllocator *pAlloc, ALLOCATOR_PROPERTIES
         return E_FAIL;
     }
 
+    _numOutputBuffers = actual.cBuffers;
+
     return S_OK;
 }
 
@@ -217,6 +246,8 @@ auto CSynthFilter::CompleteConnect(PIN_DIRECTION direction, IPin *pReceivePin) -
 
     HRESULT hr;
 
+    FrameServerPool::WaitUntilReady();
+
     if (m_pInput->IsConnected()) {
         if (!m_pOutput->IsConnected()) {
             /*
@@ -294,6 +325,8 @@ auto CSynthFilter::CompleteConnect(PIN_DIRECTION direction, IPin *pReceivePin) -
 }
 
 auto CSynthFilter::StartStreaming() -> HRESULT {
+    FrameServerPool::WaitUntilReady();
+
     AuxFrameServer::GetInstance().ReloadScript(m_pInput->CurrentMediaType(), true);
     _inputVideoFormat = Format::GetVideoFormat(m_pInput->CurrentMediaType(), &AuxFrameServer::GetInstance());
     _outputVideoFormat = Format::GetVideoFormat(m_pOutput->CurrentMediaType(), &AuxFrameServer::GetInstance());
@@ -312,6 +345,8 @@ auto CSynthFilter::StartStreaming() -> HRESULT {
 auto CSynthFilter::Receive(IMediaSample *pSample) -> HRESULT {
     HRESULT hr;
 
+    FrameServerPool::WaitUntilReady();
+
     if (m_pInput->SampleProps()->dwStreamId != AM_STREAM_MEDIA) {
         return m_pOutput->Deliver(pSample);
     }
@@ -319,10 +354,29 @@ auto CSynthFilter::Receive(IMediaSample *pSample) -> HRESULT {
     AM_MEDIA_TYPE *pmt;
     pSample->GetMediaType(&pmt);
     if (pmt != nullptr && pmt->pbFormat != nullptr) {
+        // the worker may swap the main frameserver at any time
+        Format::VideoFormat newInputVideoFormat = [pmt]() -> Format::VideoFormat {
+            const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+            return Format::GetVideoFormat(*pmt, &MainFrameServer::GetInstance());
+        }();
+
+        if (IsBufferLayoutOnlyChange(m_pInput->CurrentMediaType(), _inputVideoFormat, *pmt, newInputVideoFormat)) {
+            Environment::GetInstance().Log(L"Upstream changes input buffer layout: stride %5ld -> %5ld, size %8lu -> %8lu",
+                                           _inputVideoFormat.bmi.biWidth,
+                                           newInputVideoFormat.bmi.biWidth,
+                                           _inputVideoFormat.bmi.biSizeImage,
+                                           newInputVideoFormat.bmi.biSizeImage);
+
+            // HDR metadata comes from the side data of the samples, not the media type
+            newInputVideoFormat.hdrType = _inputVideoFormat.hdrType;
+            newInputVideoFormat.hdrLuminance = _inputVideoFormat.hdrLuminance;
+        } else {
+            _isInputMediaTypeChanged = true;
+        }
+
         m_pInput->CurrentMediaType() = *pmt;
-        _inputVideoFormat = Format::GetVideoFormat(*pmt, &MainFrameServer::GetInstance());
+        _inputVideoFormat = newInputVideoFormat;
         DeleteMediaType(pmt);
-        _isInputMediaTypeChanged = true;
     }
 
     if (ShouldSkipFrame(pSample)) {
@@ -376,16 +430,32 @@ auto CSynthFilter::BeginFlush() -> HRESULT {
 }
 
 auto CSynthFilter::EndFlush() -> HRESULT {
+    FrameServerPool::WaitUntilReady();
+
     if (IsActive()) {
         frameHandler->WaitForWorkerLatch();
-        MainFrameServer::GetInstance().StopScript();
+
+        // with warm flush, the evaluated script survives the flush, and the frame handler invalidates its frame number mapping instead
+        if (!Environment::GetInstance().IsWarmFlushEnabled()) {
+            MainFrameServer::GetInstance().StopScript();
+        }
+
         frameHandler->EndFlush();
     }
 
     return __super::EndFlush();
 }
 
+auto CSynthFilter::NewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop, double dRate) -> HRESULT {
+    Environment::GetInstance().Log(L"New segment: start %10lld stop %10lld rate %f", tStart, tStop, dRate);
+    _segmentStartTime = tStart;
+
+    return __super::NewSegment(tStart, tStop, dRate);
+}
+
 auto CSynthFilter::StopStreaming() -> HRESULT {
+    FrameServerPool::WaitUntilReady();
+
     frameHandler->BeginFlush();
     frameHandler->WaitForWorkerLatch();
     MainFrameServer::GetInstance().StopScript();
@@ -415,12 +485,15 @@ auto STDMETHODCALLTYPE CSynthFilter::GetPages(__RPC__out CAUUID *pPages) -> HRES
 }
 
 auto CSynthFilter::ReloadScript(const std::filesystem::path &scriptPath) -> void {
+    FrameServerPool::WaitUntilReady();
     FrameServerCommon::GetInstance().SetScriptPath(scriptPath);
     _needReloadScript = true;
 }
 
 auto CSynthFilter::GetFrameServerState() const -> AvsState {
-    if (MainFrameServer::GetInstance().GetErrorString()) {
+    FrameServerPool::WaitUntilReady();
+
+    if (const std::shared_lock frameServerLock = MainFrameServer::LockInstance(); MainFrameServer::GetInstance().GetErrorString()) {
         return AvsState::Error;
     }
 
@@ -434,6 +507,45 @@ auto CSynthFilter::GetFrameServerState() const -> AvsState {
     }
 }
 
+/**
+ * Evaluate the script with the input media type on the auxiliary frameserver.
+ * All media types that share the same frameserver format as the script clip are acceptable for output pin connection.
+ * Return std::nullopt if the script requests to disconnect the filter.
+ */
+auto CSynthFilter::ProbeOutputMediaTypes(AuxFrameServer &auxFrameServer, const AM_MEDIA_TYPE &inputMediaType) -> std::optional<std::vector<CMediaType>> {
+    if (!auxFrameServer.ReloadScript(inputMediaType, Environment::GetInstance().IsRemoteControlEnabled())) {
+        return std::nullopt;
+    }
+
+    std::vector<CMediaType> outputMediaTypes;
+    for (const Format::PixelFormat &frameServerPixelFormat : Format::LookupFrameServerFormatId(auxFrameServer.GetScriptPixelType())) {
+        outputMediaTypes.emplace_back(auxFrameServer.GenerateMediaType(frameServerPixelFormat, &inputMediaType));
+    }
+    return outputMediaTypes;
+}
+
+/**
+ * Decoders often attach a new media type to a sample only to change the stride or the size of the sample buffers.
+ * Such change is invisible to the script, so the input samples are converted with the new buffer layout without reloading the script.
+ */
+auto CSynthFilter::IsBufferLayoutOnlyChange(const AM_MEDIA_TYPE &oldMediaType, const Format::VideoFormat &oldVideoFormat, const AM_MEDIA_TYPE &newMediaType, const Format::VideoFormat &newVideoFormat) -> bool {
+    const Format::VideoFormat::ColorSpaceInfo &oldColorSpaceInfo = oldVideoFormat.colorSpaceInfo;
+    const Format::VideoFormat::ColorSpaceInfo &newColorSpaceInfo = newVideoFormat.colorSpaceInfo;
+
+    return oldMediaType.pbFormat != nullptr
+        && newVideoFormat.pixelFormat == oldVideoFormat.pixelFormat
+        && newVideoFormat.videoInfo.width == oldVideoFormat.videoInfo.width
+        && newVideoFormat.videoInfo.height == oldVideoFormat.videoInfo.height
+        && std::abs(newVideoFormat.bmi.biHeight) == std::abs(oldVideoFormat.bmi.biHeight)
+        && reinterpret_cast<const VIDEOINFOHEADER *>(newMediaType.pbFormat)->AvgTimePerFrame == reinterpret_cast<const VIDEOINFOHEADER *>(oldMediaType.pbFormat)->AvgTimePerFrame
+        && newVideoFormat.pixelAspectRatioNum == oldVideoFormat.pixelAspectRatioNum
+        && newVideoFormat.pixelAspectRatioDen == oldVideoFormat.pixelAspectRatioDen
+        && newColorSpaceInfo.colorRange == oldColorSpaceInfo.colorRange
+        && newColorSpaceInfo.primaries == oldColorSpaceInfo.primaries
+        && newColorSpaceInfo.matrix == oldColorSpaceInfo.matrix
+        && newColorSpaceInfo.transfer == oldColorSpaceInfo.transfer;
+}
+
 /**
  * Check if the media type has valid VideoInfo data.
  */
@@ -47,6 +47,7 @@ public:
     auto Receive(IMediaSample *pSample) -> HRESULT override;
     auto BeginFlush() -> HRESULT override;
     auto EndFlush() -> HRESULT override;
+    auto NewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop, double dRate) -> HRESULT override;
     auto StopStreaming() -> HRESULT override;
 
     // ISpecifyPropertyPages
@@ -70,6 +71,11 @@ private:
         const Format::PixelFormat *outputPixelFormat;
     };
 
+    struct ProbeMediaType {
+        std::shared_ptr<AM_MEDIA_TYPE> inputMediaType;
+        const Format::PixelFormat *inputPixelFormat;
+    };
+
     static auto InputToOutputMediaType(const AM_MEDIA_TYPE *mtIn) {
         AuxFrameServer::GetInstance().ReloadScript(*mtIn, true);
         const int scriptFormatId = AuxFrameServer::GetInstance().GetScriptPixelType();
@@ -82,13 +88,12 @@ private:
         return ret;
     }
 
+    static auto ProbeOutputMediaTypes(AuxFrameServer &auxFrameServer, const AM_MEDIA_TYPE &inputMediaType) -> std::optional<std::vector<CMediaType>>;
+    static auto IsBufferLayoutOnlyChange(const AM_MEDIA_TYPE &oldMediaType, const Format::VideoFormat &oldVideoFormat, const AM_MEDIA_TYPE &newMediaType, const Format::VideoFormat &newVideoFormat) -> bool;
     static auto MediaTypeToPixelFormat(const AM_MEDIA_TYPE *mediaType) -> const Format::PixelFormat *;
     static auto GetInputPixelFormat(const AM_MEDIA_TYPE *mediaType) -> const Format::PixelFormat *;
     static auto FindFirstVideoOutputPin(IBaseFilter *pFilter) -> std::optional<IPin *>;
 
-    // not thread-safe, but filter instances should be only created by the Graph thread
-    static inline int _numFilterInstances = 0;
-
     auto TraverseFiltersInGraph() -> void;
 
     std::unique_ptr<RemoteControl> _remoteControl = std::make_unique<RemoteControl>(*this);
@@ -100,10 +105,14 @@ private:
 
     Format::VideoFormat _inputVideoFormat;
     Format::VideoFormat _outputVideoFormat;
+    long _numOutputBuffers = 0;
 
     bool _isInputMediaTypeChanged = false;
     bool _needReloadScript = false;
 
+    // sample times are relative to the start of the current segment, which changes on every seek
+    std::atomic<REFERENCE_TIME> _segmentStartTime = 0;
+
     std::filesystem::path _videoSourcePath;
     std::vector<std::wstring> _videoFilterNames;
 };
@@ -136,6 +136,59 @@ auto Format::GetStrideAlignedMediaSampleSize(const AM_MEDIA_TYPE &mediaType, int
     return GetBitmapSize(&bmi);
 }
 
+/**
+ * Fingerprint of a sample buffer for detecting bit-identical frames.
+ * Four CRC32 streams hide the latency of the instruction. Every word feeds two streams so that any difference needs two collisions to go unnoticed.
+ */
+auto Format::HashBuffer(const BYTE *buffer, size_t size) -> uint64_t {
+    constexpr const size_t NUM_STREAMS = 4;
+    using Block = std::array<uint64_t, NUM_STREAMS>;
+
+    std::array<uint64_t, NUM_STREAMS> hashes { 0, 1, 2, 3 };
+    const size_t numBlocks = size / sizeof(Block);
+
+    // sample buffers have no alignment guarantee, so the words are copied out instead of being read in place
+    const auto loadBlock = [buffer](size_t blockIndex) -> Block {
+        Block block;
+        std::memcpy(block.data(), buffer + blockIndex * sizeof(Block), sizeof(Block));
+        return block;
+    };
+
+    if (Environment::GetInstance().IsSupportSSE4()) {
+        for (size_t i = 0; i < numBlocks; ++i) {
+            const Block block = loadBlock(i);
+
+            for (size_t s = 0; s < NUM_STREAMS; ++s) {
+#ifdef _M_X64
+                hashes[s] = _mm_crc32_u64(_mm_crc32_u64(hashes[s], block[s]), block[(s + NUM_STREAMS - 1) % NUM_STREAMS]);
+#else
+                // the 64-bit CRC32 instruction only exists on x64, feed the halves of each word instead
+                uint32_t hash = static_cast<uint32_t>(hashes[s]);
+                for (const uint64_t word : { block[s], block[(s + NUM_STREAMS - 1) % NUM_STREAMS] }) {
+                    hash = _mm_crc32_u32(_mm_crc32_u32(hash, static_cast<uint32_t>(word)), static_cast<uint32_t>(word >> 32));
+                }
+                hashes[s] = hash;
+#endif
+            }
+        }
+    } else {
+        // 64-bit FNV-1a on whole words
+        for (size_t i = 0; i < numBlocks; ++i) {
+            const Block block = loadBlock(i);
+
+            for (size_t s = 0; s < NUM_STREAMS; ++s) {
+                hashes[s] = ((hashes[s] ^ block[s]) * 0x100000001b3) ^ block[(s + NUM_STREAMS - 1) % NUM_STREAMS];
+            }
+        }
+    }
+
+    for (size_t i = numBlocks * sizeof(Block); i < size; ++i) {
+        hashes[i % NUM_STREAMS] = (hashes[i % NUM_STREAMS] ^ buffer[i]) * 0x100000001b3;
+    }
+
+    return ((hashes[0] << 32) | (hashes[1] & 0xffffffff)) ^ std::rotl((hashes[2] << 32) | (hashes[3] & 0xffffffff), 17) ^ size;
+}
+
 auto Format::DeinterleaveY410(const BYTE *src, int srcStride, std::array<BYTE *, 3> dsts, const std::array<int, 3> &dstStrides, int rowSize, int height) -> void {
     // process one plane at a time by zeroing all other planes, shuffle it from different pixels together, and fix the position by right shifting
 
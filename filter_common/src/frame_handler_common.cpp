@@ -2,6 +2,7 @@
 
 #include "constants.h"
 #include "filter.h"
+#include "thread_budget.h"
 
 
 namespace SynthFilter {
@@ -17,9 +18,27 @@ FrameHandler::~FrameHandler() {
 
         // the paired BeginFlush() is in StopStreaming()
         WaitForWorkerLatch();
+
+        // a script being evaluated for swapping reads source frames, which only return right away during flush
+        if (_scriptSwapProbe.valid()) {
+            _scriptSwapProbe.wait();
+        }
+        _abandonedScriptSwapProbes.clear();
+
+        // the environment of a swapped out script may still have threads waiting for source frames
+        if (_retiredFrameServerRelease.valid()) {
+            _retiredFrameServerRelease.wait();
+        }
+
         EndFlush();
 
         _workerThread.join();
+
+        {
+            const std::unique_lock ingestionLock(_ingestionMutex);
+        }
+        _ingestionCv.notify_all();
+        _ingestionThread.join();
     }
 }
 
@@ -27,14 +46,318 @@ auto FrameHandler::StartWorker() -> void {
     if (!_workerThread.joinable()) {
         _isStopping = false;
         _workerThread = std::thread(&FrameHandler::WorkerProc, this);
+        _ingestionThread = std::thread(&FrameHandler::IngestionProc, this);
     }
 }
 
 auto FrameHandler::WaitForWorkerLatch() -> void {
     _isWorkerLatched.wait(false);
+
+    // the ingestion thread may still be using the script
+    WaitForIngestionIdle();
+
+    // a speculatively started script may still be evaluating, which must finish before the script can be stopped
+    WaitForScriptReload();
+}
+
+/**
+ * Evaluate the main script in the background as soon as the input format is known, in parallel with filling the initial source buffer.
+ */
+auto FrameHandler::StartScriptReload() -> void {
+    WaitForScriptReload();
+
+    // fresh script, fresh frame numbers
+    _sourceFrameNbBase = 0;
+    _outputFrameNbBase = 0;
+
+    _firstSourceFrameTime = std::chrono::steady_clock::now();
+    _scriptReloadFuture = std::async(std::launch::async, [mediaType = CMediaType(_filter.m_pInput->CurrentMediaType())]() -> bool {
+#ifdef _DEBUG
+        SetThreadDescription(GetCurrentThread(), L"CSynthFilter Script Loader");
+#endif
+
+        // a failed evaluation is reported by the input path, which aborts the playback, and by the status page through the error string of the frameserver
+        const std::chrono::steady_clock::time_point reloadStartTime = std::chrono::steady_clock::now();
+        const bool isReloaded = MainFrameServer::GetInstance().ReloadScript(mediaType, true);
+        Environment::GetInstance().Log(L"Main script is evaluated in %5lld ms with result %d",
+                                       std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - reloadStartTime).count(),
+                                       isReloaded);
+        return isReloaded;
+    }).share();
+}
+
+auto FrameHandler::IngestionProc() -> void {
+    Environment::GetInstance().Log(L"Start ingestion thread");
+
+#ifdef _DEBUG
+    SetThreadDescription(GetCurrentThread(), L"CSynthFilter Ingestion");
+#endif
+
+    ThreadBudget::PinCurrentThread(Environment::GetInstance().GetIngestionThreadAffinity(), L"ingestion");
+
+    while (true) {
+        std::unique_lock ingestionLock(_ingestionMutex);
+
+        _ingestionCv.wait(ingestionLock, [this]() -> bool {
+            return _isStopping || !_pendingInputSamples.empty();
+        });
+
+        if (_isStopping) {
+            break;
+        }
+
+        InputSampleInfo inputSampleInfo = std::move(_pendingInputSamples.front());
+        _pendingInputSamples.pop_front();
+        _isIngesting = true;
+        ingestionLock.unlock();
+
+        // samples queued before a flush belong to the old segment
+        if (!_isFlushing) {
+            IngestInputSample(inputSampleInfo);
+        }
+
+        // return the buffer to upstream before accepting the next sample
+        inputSampleInfo.sample.Release();
+
+        ingestionLock.lock();
+        _isIngesting = false;
+        ingestionLock.unlock();
+        _ingestionCv.notify_all();
+    }
+
+    Environment::GetInstance().Log(L"Stop ingestion thread");
+}
+
+/**
+ * Returns false if the sample is rejected due to flush.
+ */
+auto FrameHandler::QueueInputSample(InputSampleInfo &&inputSampleInfo) -> bool {
+    // Stop() takes the receive lock before StopStreaming() can flush, so it must not be held while waiting for the ingestion thread
+    _filter.m_csReceive.Unlock();
+
+    {
+        std::unique_lock ingestionLock(_ingestionMutex);
+
+        _ingestionCv.wait(ingestionLock, [this]() -> bool {
+            // the sample being ingested also holds an upstream buffer
+            return _isFlushing || _pendingInputSamples.size() + (_isIngesting ? 1 : 0) < _maxPendingInputSamples;
+        });
+
+        if (!_isFlushing) {
+            _pendingInputSamples.emplace_back(std::move(inputSampleInfo));
+        }
+    }
+    _ingestionCv.notify_all();
+
+    _filter.m_csReceive.Lock();
+
+    return !_isFlushing;
+}
+
+/**
+ * The HDR metadata is read on the streaming thread, since it also updates the input format.
+ */
+auto FrameHandler::ReadHDRSideData(IMediaSample *inputSample) -> std::unique_ptr<HDRSideData> {
+    std::unique_ptr<HDRSideData> hdrSideData = std::make_unique<HDRSideData>();
+
+    if (const ATL::CComQIPtr<IMediaSideData> inputSampleSideData(inputSample); inputSampleSideData != nullptr) {
+        hdrSideData->ReadFrom(inputSampleSideData);
+
+        if (const std::optional<const BYTE *> optHdr = hdrSideData->GetHDRData()) {
+            _filter._inputVideoFormat.hdrType = 1;
+
+            if (const std::optional<const BYTE *> optHdrCll = hdrSideData->GetHDRContentLightLevelData()) {
+                _filter._inputVideoFormat.hdrLuminance = reinterpret_cast<const MediaSideDataHDRContentLightLevel *>(*optHdrCll)->MaxCLL;
+            } else {
+                _filter._inputVideoFormat.hdrLuminance = static_cast<int>(reinterpret_cast<const MediaSideDataHDR *>(*optHdr)->max_display_mastering_luminance);
+            }
+        }
+    }
+
+    return hdrSideData;
+}
+
+/**
+ * Every queued input sample holds one buffer from the upstream allocator. Keep at least one buffer free for the decoder.
+ */
+auto FrameHandler::UpdateIngestionQueueDepth() -> void {
+    ATL::CComPtr<IMemAllocator> allocator;
+    ALLOCATOR_PROPERTIES allocatorProps {};
+
+    if (SUCCEEDED(_filter.m_pInput->GetAllocator(&allocator)) && SUCCEEDED(allocator->GetProperties(&allocatorProps))) {
+        _maxPendingInputSamples = static_cast<size_t>(std::max(allocatorProps.cBuffers - 1L, 1L));
+    } else {
+        _maxPendingInputSamples = 1;
+    }
+
+    Environment::GetInstance().Log(L"Ingestion queue depth: %zd", _maxPendingInputSamples);
+}
+
+auto FrameHandler::WaitForIngestionIdle() -> void {
+    std::unique_lock ingestionLock(_ingestionMutex);
+
+    _pendingInputSamples.clear();
+    _ingestionCv.wait(ingestionLock, [this]() -> bool {
+        return !_isIngesting;
+    });
+}
+
+/**
+ * Returns false if the background evaluation of the main script failed.
+ */
+auto FrameHandler::WaitForScriptReload() -> bool {
+    return !_scriptReloadFuture.valid() || _scriptReloadFuture.get();
+}
+
+/**
+ * The script caches frames by their frame numbers. To keep using the script after a flush, continue the frame numbers from
+ * beyond the previous segment instead of restarting from 0. Internally, the frame handler still counts from 0.
+ */
+auto FrameHandler::RebaseFrameNumbers() -> bool {
+    const int newSourceFrameNbBase = _sourceFrameNbBase + _nextSourceFrameNb + WARM_FLUSH_FRAME_NB_GAP;
+    if (newSourceFrameNbBase > NUM_FRAMES_FOR_INFINITE_STREAM / 2) {
+        Environment::GetInstance().Log(L"Frame numbers are exhausted for warm flush");
+        return false;
+    }
+
+    _sourceFrameNbBase = newSourceFrameNbBase;
+    _outputFrameNbBase = static_cast<int>(llMulDiv(newSourceFrameNbBase,
+                                                   MainFrameServer::GetInstance().GetSourceAvgFrameDuration(),
+                                                   MainFrameServer::GetInstance().GetScriptAvgFrameDuration(),
+                                                   0));
+    Environment::GetInstance().Log(L"Rebase frame numbers: source %8d output %8d", _sourceFrameNbBase, _outputFrameNbBase);
+
+    return true;
+}
+
+/**
+ * Under sustained overload, drop source frames before conversion, so that the remaining CPU goes to the frames that can still be shown in time.
+ * Dropping only helps when source frames are piling up in front of the script. It does not help when the script is starving for input.
+ */
+auto FrameHandler::ShouldDropInputSample() -> bool {
+    // the source frames pre-buffered for the script are never dropped
+    if (!Environment::GetInstance().IsAdmissionControlEnabled() || _nextSourceFrameNb <= _initialSrcBuffer) {
+        return false;
+    }
+
+    CRefTime streamTime;
+    if (const REFERENCE_TIME lastDeliveredFrameStartTime = _lastDeliveredFrameStartTime;
+        lastDeliveredFrameStartTime < 0 || _filter.m_State != State_Running || FAILED(_filter.StreamTime(streamTime))) {
+        _isOverloaded = false;
+    } else {
+        const REFERENCE_TIME deliveryLag = streamTime - lastDeliveredFrameStartTime;
+
+        if (!_isOverloaded && deliveryLag > OVERLOAD_ENTER_DELIVERY_LAG) {
+            _isOverloaded = true;
+            Environment::GetInstance().Log(L"Enter overload mode with delivery lag %10lld", deliveryLag);
+        } else if (_isOverloaded && deliveryLag < OVERLOAD_EXIT_DELIVERY_LAG) {
+            _isOverloaded = false;
+            Environment::GetInstance().Log(L"Exit overload mode with delivery lag %10lld", deliveryLag);
+        }
+    }
+
+    if (!_isOverloaded || _numConsecutiveDroppedSourceFrames >= MAX_CONSECUTIVE_DROPPED_SRC_FRAMES) {
+        return false;
+    }
+
+    size_t numPendingInputSamples;
+    {
+        const std::unique_lock ingestionLock(_ingestionMutex);
+
+        numPendingInputSamples = _pendingInputSamples.size();
+    }
+
+    return GetInputBufferSize() + static_cast<int>(numPendingInputSamples) >= NUM_SRC_FRAMES_PER_PROCESSING;
+}
+
+/**
+ * A frame that is already late for the stream clock would be discarded by the renderer anyway.
+ * Skipping its generation and conversion lets a struggling machine catch up instead of falling further behind.
+ * The first frame after a flush is never skipped since it carries the discontinuity.
+ */
+auto FrameHandler::ShouldSkipLateOutputFrame(int outputFrameNb, REFERENCE_TIME outputStopTime) -> bool {
+    if (!Environment::GetInstance().IsLateFrameSkipEnabled() || outputFrameNb == 0 || _filter.m_State != State_Running) {
+        return false;
+    }
+
+    CRefTime streamTime;
+    if (FAILED(_filter.StreamTime(streamTime))) {
+        return false;
+    }
+
+    if (outputStopTime + llMulDiv(Environment::GetInstance().GetLateFrameSkipMargin(), UNITS, MILLISECONDS, 0) >= streamTime) {
+        return false;
+    }
+
+    _numSkippedLateFrames += 1;
+    Environment::GetInstance().Log(L"Skip late output frame %6d stop time %10lld stream time %10lld, total skipped %6d",
+                                   outputFrameNb,
+                                   outputStopTime,
+                                   static_cast<REFERENCE_TIME>(streamTime),
+                                   _numSkippedLateFrames);
+
+    return true;
+}
+
+/**
+ * Frame rate up scripts often return the very same frame for consecutive output frames.
+ * Copying the previously converted data is much cheaper than converting the frame again.
+ */
+auto FrameHandler::CopyRepeatedOutputSample(BYTE *outputBuffer, long outputBufferSize) const -> bool {
+    if (_lastOutputData.empty() || static_cast<long>(_lastOutputData.size()) > outputBufferSize) {
+        return false;
+    }
+
+    std::memcpy(outputBuffer, _lastOutputData.data(), _lastOutputData.size());
+    return true;
+}
+
+/**
+ * Once delivered, the buffer of the output sample belongs to downstream, so the converted data is copied out before delivery.
+ * Reading back from write-combined memory is too slow to be worth it.
+ */
+auto FrameHandler::KeepOutputSampleData(const BYTE *outputBuffer, long dataLength) -> bool {
+    if (MEMORY_BASIC_INFORMATION bufferInfo;
+        VirtualQuery(outputBuffer, &bufferInfo, sizeof(bufferInfo)) == 0 || (bufferInfo.Protect & PAGE_WRITECOMBINE) != 0) {
+        _lastOutputData.clear();
+        return false;
+    }
+
+    _lastOutputData.assign(outputBuffer, outputBuffer + dataLength);
+    return true;
+}
+
+/**
+ * Static scenes and sources with repeated frames (e.g. telecined or variable frame rate content) often deliver bit-identical consecutive frames.
+ * Compare the fingerprint of the input sample with the previous one to let scripts and the frame reuse short-circuit them.
+ */
+auto FrameHandler::DetectDuplicateSourceFrame(const BYTE *sampleBuffer, long sampleSize) -> bool {
+    const uint64_t frameHash = Format::HashBuffer(sampleBuffer, sampleSize);
+    const bool isDuplicate = _lastSourceFrameHash == frameHash;
+
+    _lastSourceFrameHash = frameHash;
+    if (isDuplicate) {
+        _numDuplicateSourceFrames += 1;
+    }
+
+    return isDuplicate;
+}
+
+auto FrameHandler::LogTimeToFirstFrame() const -> void {
+    Environment::GetInstance().Log(L"Time to first frame: %5lld ms",
+                                   std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _firstSourceFrameTime).count());
 }
 
 auto FrameHandler::UpdateExtraSrcBuffer() -> void {
+    // the worker may swap the main frameserver at any time
+    const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+
+    // no need to guess when the script declares exactly which source frames it reads
+    if (MainFrameServer::GetInstance().IsSourceWindowDeclared()) {
+        _extraSrcBuffer = MainFrameServer::GetInstance().GetSourcePastFrames() + MainFrameServer::GetInstance().GetSourceFutureFrames();
+        return;
+    }
+
     if (const int sourceAvgFps = MainFrameServer::GetInstance().GetSourceAvgFrameRate();
         _nextSourceFrameNb % (sourceAvgFps / FRAME_RATE_SCALE_FACTOR) == 0) {
         const double ratio = static_cast<double>(_currentInputFrameRate) / sourceAvgFps;
@@ -72,6 +395,11 @@ auto FrameHandler::RefreshFrameRatesTemplate(int sampleNb, int &checkpointSample
 }
 
 auto FrameHandler::GarbageCollect(int srcFrameNb) -> void {
+    // keep the frames that are still in the declared window of the script
+    if (MainFrameServer::GetInstance().IsSourceWindowDeclared()) {
+        srcFrameNb -= MainFrameServer::GetInstance().GetSourcePastFrames();
+    }
+
     const std::unique_lock uniqueSourceLock(_sourceMutex);
 
     const size_t dbgPreSize = _sourceFrames.size();
@@ -80,6 +408,9 @@ auto FrameHandler::GarbageCollect(int srcFrameNb) -> void {
     // this could happen by plugins that decrease frame rate
     const auto sourceEnd = _sourceFrames.end();
     for (auto iter = _sourceFrames.begin(); iter != sourceEnd && iter->first <= srcFrameNb; iter = _sourceFrames.begin()) {
+        if (iter->second.spillSlot) {
+            _sourceFrameSpill.Discard(*iter->second.spillSlot);
+        }
         _sourceFrames.erase(iter);
     }
 
@@ -88,6 +419,41 @@ auto FrameHandler::GarbageCollect(int srcFrameNb) -> void {
     Environment::GetInstance().Log(L"GarbageCollect frames until %6d pre size %3zd post size %3zd", srcFrameNb, dbgPreSize, _sourceFrames.size());
 }
 
+/**
+ * Keep the buffered source frames under the memory budget by spilling the frames farthest from the currently requested one.
+ * The frames from pinnedFirstFrameNb to pinnedLastFrameNb are never spilled.
+ * Caller must hold the unique source lock.
+ */
+auto FrameHandler::SpillSourceFrames(int hotFrameNb, int pinnedFirstFrameNb, int pinnedLastFrameNb) -> void {
+    const size_t budgetBytes = static_cast<size_t>(Environment::GetInstance().GetSourceFrameSpillBudget()) * 1024 * 1024;
+    if (budgetBytes == 0) {
+        return;
+    }
+
+    const int maxResidentFrames = std::max(static_cast<int>(budgetBytes / GetBitmapSize(&_filter._inputVideoFormat.bmi)), 1);
+    int numResidentFrames = static_cast<int>(std::ranges::count_if(_sourceFrames, [](const auto &entry) -> bool { return !entry.second.spillSlot; }));
+
+    while (numResidentFrames > maxResidentFrames) {
+        auto farthestIter = _sourceFrames.end();
+        for (auto iter = _sourceFrames.begin(); iter != _sourceFrames.end(); ++iter) {
+            if (iter->first >= pinnedFirstFrameNb && iter->first <= pinnedLastFrameNb) {
+                continue;
+            }
+
+            if (!iter->second.spillSlot && (farthestIter == _sourceFrames.end() || std::abs(iter->first - hotFrameNb) > std::abs(farthestIter->first - hotFrameNb))) {
+                farthestIter = iter;
+            }
+        }
+
+        if (farthestIter == _sourceFrames.end() || !PageOutSourceFrame(farthestIter->second)) {
+            break;
+        }
+
+        Environment::GetInstance().Log(L"Spill source frame %6d", farthestIter->first);
+        numResidentFrames -= 1;
+    }
+}
+
 auto FrameHandler::ChangeOutputFormat() -> bool {
     Environment::GetInstance().Log(L"Upstream proposes to change input format: name %ls, width %5ld, height %5ld",
                                    _filter._inputVideoFormat.pixelFormat->name,
@@ -98,6 +464,9 @@ auto FrameHandler::ChangeOutputFormat() -> bool {
 
     _filter._isInputMediaTypeChanged = false;
     _filter._needReloadScript = false;
+    AbandonScriptSwapProbe();
+    _scriptSwapFrameServer.reset();
+    _isScriptSwapPending = false;
 
     AuxFrameServer::GetInstance().ReloadScript(_filter.m_pInput->CurrentMediaType(), true);
     auto potentialOutputMediaTypes = _filter.InputToOutputMediaType(&_filter.m_pInput->CurrentMediaType());
@@ -133,6 +502,115 @@ auto FrameHandler::ChangeOutputFormat() -> bool {
     return true;
 }
 
+/**
+ * A changed script only renegotiates the output pin if it changes the output format. The new script is probed on a separate
+ * auxiliary frameserver, and if the output format is unchanged, fully evaluated on a separate main frameserver. Meanwhile the current
+ * script keeps rendering. Once ready, the worker swaps in the new main frameserver between two output frames.
+ * Return false if the output format has to be changed.
+ */
+auto FrameHandler::PrepareScriptSwap() -> bool {
+    REFERENCE_TIME outputFrameDuration;
+    {
+        // the worker may swap the main frameserver at any time
+        const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+
+        // without an active script, the next script reload picks up the new script anyway
+        if (!MainFrameServer::GetInstance().IsScriptActive()) {
+            return false;
+        }
+
+        outputFrameDuration = MainFrameServer::GetInstance().GetScriptAvgFrameDuration();
+    }
+
+    if (const std::filesystem::path &scriptPath = FrameServerCommon::GetInstance().GetScriptPath(); !_scriptSwapProbe.valid() || scriptPath != _scriptSwapPath) {
+        Environment::GetInstance().Log(L"Probe new script for swapping: %ls", scriptPath.c_str());
+
+        AbandonScriptSwapProbe();
+        _scriptSwapPath = scriptPath;
+        _scriptSwapProbe = std::async(std::launch::async,
+                                      [filter = &_filter,
+                                       inputMediaType = CMediaType(_filter.m_pInput->CurrentMediaType()),
+                                       outputPixelFormat = _filter._outputVideoFormat.pixelFormat,
+                                       outputWidth = _filter._outputVideoFormat.videoInfo.width,
+                                       outputHeight = _filter._outputVideoFormat.videoInfo.height,
+                                       outputFrameDuration]() -> std::unique_ptr<MainFrameServer> {
+#ifdef _DEBUG
+            SetThreadDescription(GetCurrentThread(), L"CSynthFilter Script Swap Probe");
+#endif
+
+            {
+                AuxFrameServer auxFrameServer;
+                if (!auxFrameServer.ReloadScript(inputMediaType, true) || static_cast<int>(auxFrameServer.GetScriptPixelType()) != outputPixelFormat->frameServerFormatId) {
+                    return nullptr;
+                }
+
+                const CMediaType newOutputMediaType = auxFrameServer.GenerateMediaType(*outputPixelFormat, &inputMediaType);
+                const Format::VideoFormat newOutputVideoFormat = Format::GetVideoFormat(newOutputMediaType, &auxFrameServer);
+                if (newOutputVideoFormat.videoInfo.width != outputWidth
+                    || newOutputVideoFormat.videoInfo.height != outputHeight
+                    || reinterpret_cast<const VIDEOINFOHEADER *>(newOutputMediaType.Format())->AvgTimePerFrame != outputFrameDuration) {
+                    return nullptr;
+                }
+            }
+
+            const std::chrono::steady_clock::time_point evaluationStartTime = std::chrono::steady_clock::now();
+            std::unique_ptr<MainFrameServer> newMainFrameServer = std::make_unique<MainFrameServer>();
+            newMainFrameServer->LinkSynthFilter(filter);
+            if (!newMainFrameServer->ReloadScript(inputMediaType, true)) {
+                return nullptr;
+            }
+            Environment::GetInstance().Log(L"New script for swapping is evaluated in %5lld ms",
+                                           std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - evaluationStartTime).count());
+
+            return newMainFrameServer;
+        });
+        return true;
+    }
+
+    if (_scriptSwapProbe.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return true;
+    }
+
+    _scriptSwapFrameServer = _scriptSwapProbe.get();
+    if (_scriptSwapFrameServer == nullptr) {
+        Environment::GetInstance().Log(L"New script changes the output format or fails to evaluate");
+        return false;
+    }
+
+    Environment::GetInstance().Log(L"New script keeps the output format, swap at the next frame boundary");
+    _filter._needReloadScript = false;
+    _isScriptSwapPending = true;
+    return true;
+}
+
+/**
+ * The receiving thread must not wait for a script evaluation while holding the receive lock, so a probe that is no longer needed is only abandoned.
+ * Its future is kept until the probe finishes, since destroying the future of std::async waits for it.
+ */
+auto FrameHandler::AbandonScriptSwapProbe() -> void {
+    std::erase_if(_abandonedScriptSwapProbes, [](const std::future<std::unique_ptr<MainFrameServer>> &probe) -> bool {
+        return probe.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    });
+
+    if (_scriptSwapProbe.valid()) {
+        _abandonedScriptSwapProbes.emplace_back(std::move(_scriptSwapProbe));
+    }
+}
+
+/**
+ * Destroy the main frameserver that was replaced by a script swap in the background, since deleting a script environment waits for its threads to finish.
+ * Nothing may reference the frames allocated by its environment any more.
+ */
+auto FrameHandler::RetireMainFrameServer(std::unique_ptr<MainFrameServer> retiredFrameServer) -> void {
+    _retiredFrameServerRelease = std::async(std::launch::async, [retiredFrameServer = std::move(retiredFrameServer)]() mutable -> void {
+#ifdef _DEBUG
+        SetThreadDescription(GetCurrentThread(), L"CSynthFilter Script Retirement");
+#endif
+
+        retiredFrameServer.reset();
+    });
+}
+
 auto FrameHandler::RefreshInputFrameRates(int frameNb) -> void {
     RefreshFrameRatesTemplate(frameNb, _frameRateCheckpointInputSampleNb, _frameRateCheckpointInputSampleTime, _currentInputFrameRate);
 }
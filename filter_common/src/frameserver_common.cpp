@@ -2,6 +2,8 @@
 
 #include "frameserver.h"
 
+#include "thread_budget.h"
+
 
 namespace SynthFilter {
 
@@ -9,10 +11,35 @@ auto FrameServerCommon::SetScriptPath(const std::filesystem::path &scriptPath) -
     _scriptPath = scriptPath;
 }
 
+auto MainFrameServer::IsScriptActive() const -> bool {
+    return _scriptClip != nullptr;
+}
+
 auto MainFrameServer::GetErrorString() const -> std::optional<std::string> {
     return _errorString.empty() ? std::nullopt : std::make_optional(_errorString);
 }
 
+/**
+ * Frameserver cache limit in MiB for the evaluated script, or 0 if no memory target is configured.
+ * The source buffer of the filter is taken out of the memory target first, since both hold frames of the same size.
+ */
+auto MainFrameServer::CalculateCacheLimit(const AM_MEDIA_TYPE &mediaType) const -> int {
+    const int memoryTarget = Environment::GetInstance().GetMemoryTarget();
+    if (memoryTarget == 0) {
+        return 0;
+    }
+
+    const int64_t frameBytes = GetBitmapSize(Format::GetBitmapInfo(mediaType));
+    const int windowFrames = _isSourceWindowDeclared ? _sourcePastFrames + _sourceFutureFrames + 1 : Environment::GetInstance().GetMaxExtraSrcBuffer() + 1;
+    const int sourceBufferFrames = Environment::GetInstance().GetInitialSrcBuffer() + windowFrames;
+
+    // every frameserver thread may work on its own window of frames at the same time
+    const int64_t minCacheBytes = frameBytes * windowFrames * ThreadBudget::GetFrameServerThreads();
+    const int64_t cacheBytes = std::max(memoryTarget * 1024LL * 1024 - frameBytes * sourceBufferFrames, minCacheBytes);
+
+    return static_cast<int>((cacheBytes + 1024 * 1024 - 1) / (1024 * 1024));
+}
+
 /**
  * Create media type based on a template while changing its subtype. Also change fields in format if necessary.
  *
@@ -34,10 +61,9 @@ auto AuxFrameServer::GenerateMediaType(const Format::PixelFormat &pixelFormat, c
 
         // if the script changes the video dimension, we need to adjust the DAR
         // assuming the pixel aspect ratio remains the same, new DAR = PAR / new (script) SAR
-        const auto &sourceVideoInfo = FrameServerCommon::GetInstance()._sourceVideoInfo;
-        if (_scriptVideoInfo.width != sourceVideoInfo.width || _scriptVideoInfo.height != sourceVideoInfo.height) {
-            unsigned long long darX = static_cast<unsigned long long>(newVih2->dwPictAspectRatioX) * sourceVideoInfo.height * _scriptVideoInfo.width;
-            unsigned long long darY = static_cast<unsigned long long>(newVih2->dwPictAspectRatioY) * sourceVideoInfo.width * _scriptVideoInfo.height;
+        if (_scriptVideoInfo.width != _sourceVideoInfo.width || _scriptVideoInfo.height != _sourceVideoInfo.height) {
+            unsigned long long darX = static_cast<unsigned long long>(newVih2->dwPictAspectRatioX) * _sourceVideoInfo.height * _scriptVideoInfo.width;
+            unsigned long long darY = static_cast<unsigned long long>(newVih2->dwPictAspectRatioY) * _sourceVideoInfo.width * _scriptVideoInfo.height;
             CoprimeIntegers(darX, darY);
             newVih2->dwPictAspectRatioX = static_cast<DWORD>(darX);
             newVih2->dwPictAspectRatioY = static_cast<DWORD>(darY);
@@ -0,0 +1,148 @@
+// License: https://github.com/CrendKing/avisynth_filter/blob/master/LICENSE
+
+#include "frameserver_pool.h"
+
+#include "filter.h"
+
+
+namespace SynthFilter {
+
+auto FrameServerPool::Lease(const CSynthFilter *filter) -> void {
+    std::jthread idleThread;
+
+    {
+        const std::unique_lock lock(_mutex);
+
+        _numLeases += 1;
+        if (_numLeases == 1) {
+            idleThread = std::move(_idleThread);
+            _moduleLock.reset();
+
+            if (_isWarm) {
+                // cancel the pending teardown
+                _isWarm = false;
+                _leaseCv.notify_all();
+
+                // the settings may have been changed in the registry or the ini file while the frameservers were kept warm
+                Environment::Destroy();
+                Environment::Create();
+                Environment::GetInstance().Log(L"Lease warm frameservers");
+                FrameServerCommon::GetInstance().SetScriptPath(Environment::GetInstance().GetScriptPath());
+                MainFrameServer::GetInstance().LinkSynthFilter(filter);
+            } else {
+                Environment::Create();
+                _warmUp = std::async(std::launch::async, CreateFrameServers, filter).share();
+            }
+        }
+    }
+
+    // the idle thread needs the mutex to see the cancellation
+    if (idleThread.joinable()) {
+        idleThread.join();
+    }
+}
+
+auto FrameServerPool::Release() -> void {
+    const std::unique_lock lock(_mutex);
+
+    _numLeases -= 1;
+    if (_numLeases > 0) {
+        return;
+    }
+
+    // the frameservers must be fully created before they can be stopped or destroyed
+    if (_warmUp.valid()) {
+        _warmUp.wait();
+    }
+
+    const int idleTimeout = Environment::GetInstance().GetFrameServerIdleTimeout();
+    if (idleTimeout == 0) {
+        DestroyFrameServers();
+        return;
+    }
+
+    // the script clip reads from the frame handler of the released filter
+    MainFrameServer::GetInstance().StopScript();
+
+    _isWarm = true;
+    _idleGeneration += 1;
+    _moduleLock = std::make_unique<CBaseObject>(NAME("FrameServerPool"));
+    Environment::GetInstance().Log(L"Keep frameservers warm for %d seconds", idleTimeout);
+
+    // joined by the next Lease(), or by ReapIdleThread() once the module is asked to unload
+    // the module lock is kept past the teardown until then, so that the module stays loaded while the thread runs
+    _idleThread = std::jthread([idleTimeout, idleGeneration = _idleGeneration]() -> void {
+#ifdef _DEBUG
+        SetThreadDescription(GetCurrentThread(), L"CSynthFilter Frameserver Pool");
+#endif
+
+        std::unique_lock idleLock(_mutex);
+        if (!_leaseCv.wait_for(idleLock, std::chrono::seconds(idleTimeout), [idleGeneration]() -> bool {
+                return !_isWarm || _idleGeneration != idleGeneration;
+            })) {
+            _isWarm = false;
+            DestroyFrameServers();
+        }
+    });
+}
+
+/**
+ * Called when COM asks if the module can be unloaded. Once the idle thread has torn down the frameservers, join it and drop the module lock.
+ */
+auto FrameServerPool::ReapIdleThread() -> void {
+    std::jthread idleThread;
+
+    {
+        const std::unique_lock lock(_mutex);
+
+        if (_numLeases > 0 || _isWarm || !_idleThread.joinable()) {
+            return;
+        }
+
+        idleThread = std::move(_idleThread);
+    }
+
+    idleThread.join();
+
+    const std::unique_lock lock(_mutex);
+    _moduleLock.reset();
+}
+
+auto FrameServerPool::WaitUntilReady() -> void {
+    std::shared_future<void> warmUp;
+    {
+        const std::unique_lock lock(_mutex);
+        warmUp = _warmUp;
+    }
+
+    if (warmUp.valid()) {
+        warmUp.wait();
+    }
+}
+
+auto FrameServerPool::CreateFrameServers(const CSynthFilter *filter) -> void {
+#ifdef _DEBUG
+    SetThreadDescription(GetCurrentThread(), L"CSynthFilter Frameserver Warm-up");
+#endif
+
+    const auto warmUpStart = std::chrono::steady_clock::now();
+
+    FrameServerCommon::Create();
+    MainFrameServer::Create().LinkSynthFilter(filter);
+    AuxFrameServer::Create();
+    Format::Initialize();
+
+    Environment::GetInstance().Log(L"Frameserver warm-up took %lld ms",
+                                   std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - warmUpStart).count());
+}
+
+auto FrameServerPool::DestroyFrameServers() -> void {
+    _warmUp = {};
+
+    AuxFrameServer::Destroy();
+    MainFrameServer::Destroy();
+    FrameServerCommon::Destroy();
+    Environment::Destroy();
+}
+
+}
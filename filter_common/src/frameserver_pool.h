@@ -0,0 +1,44 @@
+// License: https://github.com/CrendKing/avisynth_filter/blob/master/LICENSE
+
+#pragma once
+
+
+namespace SynthFilter {
+
+class CSynthFilter;
+
+/**
+ * Owns the lifetime of the process-wide frameserver singletons on behalf of the filter instances.
+ * Each filter instance leases them while it exists. When the last lease is returned, the initialized environments can be kept warm
+ * for an idle timeout, so that players which rebuild the graph per file do not pay the frameserver initialization for every file.
+ *
+ * Cold frameservers are created on a background thread, so that the graph builder can continue while the environments initialize.
+ * Everything that touches the frameserver singletons or the formats outside of the frame handler has to call WaitUntilReady() first,
+ * which includes every pin negotiation and streaming entry point of the filter.
+ */
+class FrameServerPool {
+public:
+    static auto Lease(const CSynthFilter *filter) -> void;
+    static auto Release() -> void;
+    static auto WaitUntilReady() -> void;
+    static auto ReapIdleThread() -> void;
+
+private:
+    static auto CreateFrameServers(const CSynthFilter *filter) -> void;
+    static auto DestroyFrameServers() -> void;
+
+    static inline std::mutex _mutex;
+    static inline std::condition_variable _leaseCv;
+    static inline int _numLeases = 0;
+    static inline bool _isWarm = false;
+    static inline std::shared_future<void> _warmUp;
+
+    // distinguishes the idle period that a teardown thread waits for from the later ones
+    static inline int _idleGeneration = 0;
+    static inline std::jthread _idleThread;
+
+    // keeps the module from being unloaded by CoFreeUnusedLibraries() while the frameservers are kept warm, and until the idle thread is joined
+    static inline std::unique_ptr<CBaseObject> _moduleLock;
+};
+
+}
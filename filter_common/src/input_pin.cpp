@@ -5,6 +5,7 @@
 #include "allocator.h"
 #include "constants.h"
 #include "format.h"
+#include "frameserver_pool.h"
 #include "macros.h"
 
 
@@ -16,6 +17,8 @@ CSynthFilterInputPin::CSynthFilterInputPin(__in_opt LPCTSTR pObjectName, __inout
 auto STDMETHODCALLTYPE CSynthFilterInputPin::ReceiveConnection(IPin *pConnector, const AM_MEDIA_TYPE *pmt) -> HRESULT {
     HRESULT hr;
 
+    FrameServerPool::WaitUntilReady();
+
     const HRESULT receiveConnectionHr = __super::ReceiveConnection(pConnector, pmt);
     if (receiveConnectionHr == VFW_E_ALREADY_CONNECTED) {
         ASSERT(m_pAllocator != nullptr);
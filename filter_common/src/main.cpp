@@ -2,6 +2,7 @@
 
 #include "constants.h"
 #include "filter.h"
+#include "frameserver_pool.h"
 #include "prop_settings.h"
 #include "prop_status.h"
 
@@ -121,6 +122,12 @@ auto STDAPICALLTYPE DllUnregisterServer() -> HRESULT {
     return AMovieDllRegisterServer2(FALSE);
 }
 
+// exported as DllCanUnloadNow, so that the frameservers torn down after the idle timeout release the module first
+extern "C" auto STDAPICALLTYPE SynthFilterCanUnloadNow() -> HRESULT {
+    SynthFilter::FrameServerPool::ReapIdleThread();
+    return DllCanUnloadNow();
+}
+
 extern "C" DECLSPEC_NOINLINE auto WINAPI DllEntryPoint(HINSTANCE hInstance, ULONG ulReason, __inout_opt LPVOID pv) -> BOOL;
 
 auto APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserved) -> BOOL {
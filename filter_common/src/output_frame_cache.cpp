@@ -0,0 +1,70 @@
+// License: https://github.com/CrendKing/avisynth_filter/blob/master/LICENSE
+
+#include "output_frame_cache.h"
+
+
+namespace SynthFilter {
+
+auto OutputFrameCache::SetBudget(size_t budgetBytes) -> void {
+    _budgetBytes = budgetBytes;
+    EvictUntil(_budgetBytes);
+}
+
+auto OutputFrameCache::SetIdentity(size_t identity) -> void {
+    if (identity != _identity) {
+        Clear();
+        _identity = identity;
+    }
+}
+
+auto OutputFrameCache::Clear() -> void {
+    _entries.clear();
+    _lruKeys.clear();
+    _usedBytes = 0;
+}
+
+auto OutputFrameCache::Lookup(REFERENCE_TIME sourceStartTime, REFERENCE_TIME outputStartTime, BYTE *dstBuffer, long dstBufferSize, DWORD &typeSpecificFlags) -> bool {
+    const auto iter = _entries.find({ sourceStartTime, outputStartTime });
+    if (iter == _entries.end() || static_cast<long>(iter->second.data.size()) > dstBufferSize) {
+        return false;
+    }
+
+    std::memcpy(dstBuffer, iter->second.data.data(), iter->second.data.size());
+    typeSpecificFlags = iter->second.typeSpecificFlags;
+
+    _lruKeys.splice(_lruKeys.begin(), _lruKeys, iter->second.lruIter);
+    _numHits += 1;
+
+    return true;
+}
+
+auto OutputFrameCache::Store(REFERENCE_TIME sourceStartTime, REFERENCE_TIME outputStartTime, const BYTE *srcBuffer, long srcBufferSize, DWORD typeSpecificFlags) -> void {
+    const size_t frameBytes = static_cast<size_t>(srcBufferSize);
+    if (frameBytes > _budgetBytes) {
+        return;
+    }
+
+    const Key key { sourceStartTime, outputStartTime };
+    if (const auto iter = _entries.find(key); iter != _entries.end()) {
+        _lruKeys.erase(iter->second.lruIter);
+        _usedBytes -= iter->second.data.size();
+        _entries.erase(iter);
+    }
+
+    EvictUntil(_budgetBytes - frameBytes);
+
+    _lruKeys.emplace_front(key);
+    _entries.emplace(key, Entry { std::vector<BYTE>(srcBuffer, srcBuffer + frameBytes), typeSpecificFlags, _lruKeys.begin() });
+    _usedBytes += frameBytes;
+}
+
+auto OutputFrameCache::EvictUntil(size_t targetBytes) -> void {
+    while (_usedBytes > targetBytes && !_lruKeys.empty()) {
+        const auto iter = _entries.find(_lruKeys.back());
+        _usedBytes -= iter->second.data.size();
+        _entries.erase(iter);
+        _lruKeys.pop_back();
+    }
+}
+
+}
@@ -0,0 +1,49 @@
+// License: https://github.com/CrendKing/avisynth_filter/blob/master/LICENSE
+
+#pragma once
+
+#include "macros.h"
+
+
+namespace SynthFilter {
+
+/**
+ * Bounded LRU cache of recently delivered output frames, in the converted form of the output sample buffer.
+ * Frames are keyed by the start times of the source frame and the output frame within the whole stream, and belong to one script identity.
+ * Any change of the identity, e.g. a different script, source or output format, invalidates the whole cache.
+ */
+class OutputFrameCache {
+public:
+    CTOR_WITHOUT_COPYING(OutputFrameCache)
+
+    auto SetBudget(size_t budgetBytes) -> void;
+    auto SetIdentity(size_t identity) -> void;
+    auto Clear() -> void;
+    auto Lookup(REFERENCE_TIME sourceStartTime, REFERENCE_TIME outputStartTime, BYTE *dstBuffer, long dstBufferSize, DWORD &typeSpecificFlags) -> bool;
+    auto Store(REFERENCE_TIME sourceStartTime, REFERENCE_TIME outputStartTime, const BYTE *srcBuffer, long srcBufferSize, DWORD typeSpecificFlags) -> void;
+    constexpr auto IsEnabled() const -> bool { return _budgetBytes > 0; }
+    constexpr auto GetNumHits() const -> int { return _numHits; }
+
+private:
+    using Key = std::pair<REFERENCE_TIME, REFERENCE_TIME>;
+
+    struct Entry {
+        std::vector<BYTE> data;
+        DWORD typeSpecificFlags;
+        std::list<Key>::iterator lruIter;
+    };
+
+    auto EvictUntil(size_t targetBytes) -> void;
+
+    std::map<Key, Entry> _entries;
+
+    // most recently used at the front
+    std::list<Key> _lruKeys;
+
+    size_t _budgetBytes = 0;
+    size_t _usedBytes = 0;
+    size_t _identity = 0;
+    int _numHits = 0;
+};
+
+}
@@ -8,12 +8,18 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <charconv>
 #include <chrono>
 #include <clocale>
 #include <condition_variable>
+#include <deque>
 #include <filesystem>
 #include <format>
+#include <fstream>
 #include <functional>
+#include <future>
+#include <list>
 #include <map>
 #include <memory>
 #include <mutex>
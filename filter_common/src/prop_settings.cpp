@@ -3,6 +3,7 @@
 #include "prop_settings.h"
 
 #include "constants.h"
+#include "frameserver_pool.h"
 
 
 namespace SynthFilter {
@@ -15,6 +16,9 @@ auto CSynthFilterPropSettings::OnConnect(IUnknown *pUnk) -> HRESULT {
     _filter = reinterpret_cast<CSynthFilter *>(pUnk);
     _filter->AddRef();
 
+    // the pages read from the frameservers, which may still be warming up if the pages are opened right after the filter is added
+    FrameServerPool::WaitUntilReady();
+
     return S_OK;
 }
 
@@ -3,6 +3,7 @@
 #include "prop_status.h"
 
 #include "constants.h"
+#include "frameserver_pool.h"
 
 
 namespace SynthFilter {
@@ -15,6 +16,9 @@ auto CSynthFilterPropStatus::OnConnect(IUnknown *pUnk) -> HRESULT {
     _filter = reinterpret_cast<CSynthFilter *>(pUnk);
     _filter->AddRef();
 
+    // the pages read from the frameservers, which may still be warming up if the pages are opened right after the filter is added
+    FrameServerPool::WaitUntilReady();
+
     return S_OK;
 }
 
@@ -75,6 +79,29 @@ auto CSynthFilterPropStatus::OnReceiveMessage(HWND hwnd, UINT uMsg, WPARAM wPara
 
         SetDlgItemTextW(hwnd, IDC_TEXT_FRAME_RATE_VALUE, std::format(L"{} -> {} -> {}", inputFrameRateStr, outputFrameRateStr, deliveryFrameRateStr).c_str());
         SetDlgItemTextW(hwnd, IDC_TEXT_PAR_VALUE, outputParStr.c_str());
+        SetDlgItemTextW(hwnd, IDC_TEXT_LATENCY_VALUE, std::format(L"{} ms", llMulDiv(_filter->frameHandler->GetCurrentOutputLatency(), 1000, UNITS, 0)).c_str());
+        SetDlgItemTextW(hwnd,
+                        IDC_TEXT_SKIPPED_FRAMES_VALUE,
+                        std::format(L"{} / {}", _filter->frameHandler->GetNumDroppedSourceFrames(), _filter->frameHandler->GetNumSkippedLateFrames()).c_str());
+
+        if (Environment::GetInstance().IsDuplicateFrameDetectionEnabled()) {
+            const int numDuplicateFrames = _filter->frameHandler->GetNumDuplicateSourceFrames();
+            const int numSourceFrames = _filter->frameHandler->GetSourceFrameNb();
+            SetDlgItemTextW(hwnd,
+                            IDC_TEXT_DUPLICATE_FRAMES_VALUE,
+                            std::format(L"{} ({}%)", numDuplicateFrames, numSourceFrames == 0 ? 0 : numDuplicateFrames * 100 / numSourceFrames).c_str());
+        }
+
+        if (Environment::GetInstance().GetSourceFrameSpillBudget() > 0) {
+            SetDlgItemTextW(hwnd,
+                            IDC_TEXT_SPILLED_FRAMES_VALUE,
+                            std::format(L"{} / {}", _filter->frameHandler->GetNumSpilledSourceFrames(), _filter->frameHandler->GetNumRefilledSourceFrames()).c_str());
+        }
+
+        {
+            const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+            SetDlgItemTextW(hwnd, IDC_TEXT_CACHE_LIMIT_VALUE, std::format(L"{} MiB", MainFrameServer::GetInstance().GetCacheLimit()).c_str());
+        }
 
         if (!_isSourcePathSet) {
             std::wstring_view videoSourcePath = _filter->GetVideoSourcePath().c_str();
@@ -44,6 +44,23 @@ auto Registry::ReadNumber(const WCHAR *valueName, int defaultValue) const -> DWO
     return ret;
 }
 
+/**
+ * Accept both REG_QWORD and REG_DWORD values, the latter being zero extended.
+ */
+auto Registry::ReadQword(const WCHAR *valueName, ULONGLONG defaultValue) const -> ULONGLONG {
+    ULONGLONG ret = defaultValue;
+
+    if (_registryKey) {
+        ULONGLONG value = 0;
+        DWORD valueSize = sizeof(value);
+        if (RegGetValueW(_registryKey, nullptr, valueName, RRF_RT_QWORD | RRF_RT_DWORD, nullptr, &value, &valueSize) == ERROR_SUCCESS) {
+            ret = value;
+        }
+    }
+
+    return ret;
+}
+
 auto Registry::WriteString(const WCHAR *valueName, std::wstring_view valueString) const -> bool {
     return _registryKey && RegSetValueExW(_registryKey,
                                           valueName,
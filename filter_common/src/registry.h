@@ -18,6 +18,7 @@ public:
 
     auto ReadString(const WCHAR *valueName) const -> std::wstring;
     auto ReadNumber(const WCHAR *valueName, int defaultValue) const -> DWORD;
+    auto ReadQword(const WCHAR *valueName, ULONGLONG defaultValue) const -> ULONGLONG;
     auto WriteString(const WCHAR *valueName, std::wstring_view valueString) const -> bool;
     auto WriteNumber(const WCHAR *valueName, DWORD valueNumber) const -> bool;
 
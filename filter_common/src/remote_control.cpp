@@ -4,6 +4,7 @@
 
 #include "constants.h"
 #include "filter.h"
+#include "frameserver_pool.h"
 
 
 namespace SynthFilter {
@@ -124,6 +125,8 @@ auto RemoteControl::HandleCopyData(HWND hSenderWindow, const COPYDATASTRUCT *cop
         return FALSE;
     }
 
+    FrameServerPool::WaitUntilReady();
+
     switch (copyData->dwData) {
     case API_MSG_GET_API_VERSION:
         return API_VERSION;
@@ -157,8 +160,10 @@ auto RemoteControl::HandleCopyData(HWND hSenderWindow, const COPYDATASTRUCT *cop
     case API_MSG_GET_INPUT_HDR_LUMINANCE:
         return _filter.GetInputFormat().hdrLuminance;
 
-    case API_MSG_GET_SOURCE_AVG_FPS:
+    case API_MSG_GET_SOURCE_AVG_FPS: {
+        const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
         return MainFrameServer::GetInstance().GetSourceAvgFrameRate();
+    }
 
     case API_MSG_GET_CURRENT_OUTPUT_FPS:
         return _filter.frameHandler->GetCurrentOutputFrameRate();
@@ -166,13 +171,20 @@ auto RemoteControl::HandleCopyData(HWND hSenderWindow, const COPYDATASTRUCT *cop
     case API_MSG_GET_AVS_STATE:
         return static_cast<LRESULT>(_filter.GetFrameServerState());
 
-    case API_MSG_GET_AVS_ERROR:
-        if (const std::optional<std::string> optFrameServerError = MainFrameServer::GetInstance().GetErrorString()) {
+    case API_MSG_GET_AVS_ERROR: {
+        std::optional<std::string> optFrameServerError;
+        {
+            const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+            optFrameServerError = MainFrameServer::GetInstance().GetErrorString();
+        }
+
+        if (optFrameServerError) {
             SendString(hSenderWindow, copyData->dwData, *optFrameServerError);
             return TRUE;
         }
 
         return FALSE;
+    }
 
     case API_MSG_GET_AVS_SOURCE_FILE: {
         const std::filesystem::path &effectiveScriptPath = FrameServerCommon::GetInstance().GetScriptPath();
@@ -184,6 +196,11 @@ auto RemoteControl::HandleCopyData(HWND hSenderWindow, const COPYDATASTRUCT *cop
         return TRUE;
     }
 
+    case API_MSG_GET_AVS_CACHE_LIMIT: {
+        const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+        return MainFrameServer::GetInstance().GetCacheLimit();
+    }
+
     case API_MSG_SET_AVS_SOURCE_FILE: {
         const char *newScriptPathPtr = static_cast<const char *>(copyData->lpData);
         _filter.ReloadScript(std::filesystem::path(newScriptPathPtr, newScriptPathPtr + copyData->cbData));
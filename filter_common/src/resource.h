@@ -51,6 +51,16 @@
 #define IDC_TEXT_FRAME_RATE_VALUE        2006
 #define IDC_TEXT_PAR                     2007
 #define IDC_TEXT_PAR_VALUE               2008
+#define IDC_TEXT_LATENCY                 2009
+#define IDC_TEXT_LATENCY_VALUE           2010
+#define IDC_TEXT_SKIPPED_FRAMES          2011
+#define IDC_TEXT_SKIPPED_FRAMES_VALUE    2012
+#define IDC_TEXT_DUPLICATE_FRAMES        2013
+#define IDC_TEXT_DUPLICATE_FRAMES_VALUE  2014
+#define IDC_TEXT_SPILLED_FRAMES          2015
+#define IDC_TEXT_SPILLED_FRAMES_VALUE    2016
+#define IDC_TEXT_CACHE_LIMIT             2017
+#define IDC_TEXT_CACHE_LIMIT_VALUE       2018
 #define IDC_TEXT_PATH                    2100
 #define IDC_EDIT_PATH_VALUE              2101
 #define IDC_TEXT_FORMAT                  2102
@@ -0,0 +1,222 @@
+// License: https://github.com/CrendKing/avisynth_filter/blob/master/LICENSE
+
+#include "script_probe.h"
+
+#include "constants.h"
+
+
+namespace {
+
+constexpr const char PROBE_CACHE_FIELD_DELIMITER = '\t';
+
+}
+
+namespace SynthFilter {
+
+auto ScriptProbeKey::Create(const std::filesystem::path &scriptPath, uint64_t frameServerHash, const AM_MEDIA_TYPE &mediaType, bool ignoreDisconnect, std::string_view sourcePathName) -> std::optional<ScriptProbeKey> {
+    // hash the content instead of the modification time, so that an edited script is probed again even if saved within the same second
+    uint64_t scriptHash = 0;
+    if (!scriptPath.empty()) {
+        std::ifstream scriptFile(scriptPath, std::ios::binary);
+        const std::string scriptContent((std::istreambuf_iterator<char>(scriptFile)), std::istreambuf_iterator<char>());
+
+        if (scriptContent.find(sourcePathName) != std::string::npos) {
+            return std::nullopt;
+        }
+
+        scriptHash = Format::HashBuffer(reinterpret_cast<const BYTE *>(scriptContent.data()), scriptContent.size());
+    }
+
+    const VIDEOINFOHEADER *vih = reinterpret_cast<VIDEOINFOHEADER *>(mediaType.pbFormat);
+    const BITMAPINFOHEADER *bmi = Format::GetBitmapInfo(mediaType);
+
+    return ScriptProbeKey {
+        .scriptPath = scriptPath,
+        .scriptHash = scriptHash,
+        .frameServerHash = frameServerHash,
+        .pixelFormat = Format::LookupMediaSubtype(mediaType.subtype),
+        .width = bmi->biWidth,
+        .height = abs(bmi->biHeight),
+        .avgFrameDuration = vih->AvgTimePerFrame,
+        .ignoreDisconnect = ignoreDisconnect,
+    };
+}
+
+/**
+ * Plugins rarely carry a version the filter could query, so they are identified by the paths, sizes and modification times of their files.
+ * Directories are expanded into the files they directly contain.
+ */
+auto ScriptProbeKey::HashFrameServer(std::string_view versionString, const std::vector<std::filesystem::path> &pluginPaths) -> uint64_t {
+    std::vector<std::filesystem::path> pluginFiles;
+    for (const std::filesystem::path &pluginPath : pluginPaths) {
+        if (std::error_code ec; std::filesystem::is_directory(pluginPath, ec)) {
+            for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(pluginPath, ec)) {
+                if (entry.is_regular_file(ec)) {
+                    pluginFiles.emplace_back(entry.path());
+                }
+            }
+        } else {
+            pluginFiles.emplace_back(pluginPath);
+        }
+    }
+    std::ranges::sort(pluginFiles);
+
+    std::wstring fingerprint = ConvertUtf8ToWide(versionString);
+    for (const std::filesystem::path &pluginFile : pluginFiles) {
+        std::error_code ec;
+        fingerprint += std::format(L"\n{}|{}|{}",
+                                   pluginFile.native(),
+                                   std::filesystem::file_size(pluginFile, ec),
+                                   std::filesystem::last_write_time(pluginFile, ec).time_since_epoch().count());
+    }
+
+    return Format::HashBuffer(reinterpret_cast<const BYTE *>(fingerprint.data()), fingerprint.size() * sizeof(WCHAR));
+}
+
+/**
+ * Read the persisted results once per process. Every line after the version header holds one result:
+ * script path, script hash, frameserver hash, pixel format, width, height, frame duration, disconnect handling and the result bytes in hex.
+ */
+auto ScriptProbeCache::Load(std::string_view frameServerVersion) -> void {
+    const std::unique_lock lock(_mutex);
+
+    if (_isLoaded) {
+        return;
+    }
+    _isLoaded = true;
+
+    if (!Environment::GetInstance().IsPersistentProbeCacheEnabled()) {
+        return;
+    }
+
+    std::array<WCHAR, MAX_PATH> localAppDataStr {};
+    if (GetEnvironmentVariableW(L"LOCALAPPDATA", localAppDataStr.data(), static_cast<DWORD>(localAppDataStr.size())) == 0) {
+        return;
+    }
+    _cachePath = std::filesystem::path(localAppDataStr.data()) / FILTER_FILENAME_BASE;
+    _cachePath.replace_extension(PROBE_CACHE_FILE_EXTENSION);
+    _versionHeader = std::format("{} {}", FILTER_VERSION_STRING, frameServerVersion);
+
+    const CacheFileLock cacheFileLock;
+
+    for (const std::string &line : ReadCacheFile()) {
+        if (std::optional<std::pair<ScriptProbeKey, std::vector<BYTE>>> optEntry = ParseEntry(line)) {
+            _results.insert_or_assign(std::move(optEntry->first), std::move(optEntry->second));
+        }
+    }
+
+    Environment::GetInstance().Log(L"Loaded %zd persisted probe results", _results.size());
+}
+
+auto ScriptProbeCache::StoreBytes(const ScriptProbeKey &key, std::vector<BYTE> resultBytes) -> void {
+    const std::unique_lock lock(_mutex);
+
+    if (!_cachePath.empty() && key.pixelFormat != nullptr) {
+        std::string resultHex;
+        for (const BYTE b : resultBytes) {
+            resultHex += std::format("{:02x}", b);
+        }
+
+        const std::string entryKey = std::format("{1}{0}{2:x}{0}{3:x}{0}{4}{0}{5}{0}{6}{0}{7}{0}{8:d}{0}",
+                                                 PROBE_CACHE_FIELD_DELIMITER,
+                                                 ConvertWideToUtf8(key.scriptPath.native()),
+                                                 key.scriptHash,
+                                                 key.frameServerHash,
+                                                 ConvertWideToUtf8(key.pixelFormat->name),
+                                                 key.width,
+                                                 key.height,
+                                                 key.avgFrameDuration,
+                                                 key.ignoreDisconnect);
+
+        // other processes may have stored their results since this one loaded the file, so merge into the current content
+        const CacheFileLock cacheFileLock;
+
+        std::vector<std::string> lines = ReadCacheFile();
+        std::erase_if(lines, [&entryKey](const std::string &line) -> bool {
+            return line.starts_with(entryKey) || !ParseEntry(line);
+        });
+        lines.emplace_back(entryKey + resultHex);
+        if (lines.size() > static_cast<size_t>(MAX_PERSISTED_PROBE_RESULTS)) {
+            lines.erase(lines.begin(), lines.end() - MAX_PERSISTED_PROBE_RESULTS);
+        }
+
+        if (std::ofstream cacheFile(_cachePath, std::ios::trunc); cacheFile.is_open()) {
+            cacheFile << _versionHeader << '\n';
+            for (const std::string &line : lines) {
+                cacheFile << line << '\n';
+            }
+        } else {
+            Environment::GetInstance().Log(L"Unable to write probe cache file: %ls", _cachePath.c_str());
+        }
+    }
+
+    _results.insert_or_assign(key, std::move(resultBytes));
+}
+
+/**
+ * Returns the result lines of the cache file, oldest first. A missing or outdated file has none.
+ */
+auto ScriptProbeCache::ReadCacheFile() const -> std::vector<std::string> {
+    std::vector<std::string> lines;
+
+    if (std::ifstream cacheFile(_cachePath); cacheFile.is_open()) {
+        std::string line;
+        if (std::getline(cacheFile, line) && line == _versionHeader) {
+            while (std::getline(cacheFile, line)) {
+                lines.emplace_back(std::move(line));
+            }
+        }
+    }
+
+    return lines;
+}
+
+auto ScriptProbeCache::ParseEntry(std::string_view line) -> std::optional<std::pair<ScriptProbeKey, std::vector<BYTE>>> {
+    std::vector<std::string_view> fields;
+    for (const auto field : std::views::split(line, PROBE_CACHE_FIELD_DELIMITER)) {
+        fields.emplace_back(field.begin(), field.end());
+    }
+    if (fields.size() != 9 || fields[8].size() % 2 != 0) {
+        return std::nullopt;
+    }
+
+    const std::wstring pixelFormatName = ConvertUtf8ToWide(fields[3]);
+    const auto pixelFormatIter = std::ranges::find_if(Format::PIXEL_FORMATS, [&pixelFormatName](const Format::PixelFormat &pixelFormat) -> bool {
+        return pixelFormatName == pixelFormat.name;
+    });
+    if (pixelFormatIter == Format::PIXEL_FORMATS.end()) {
+        return std::nullopt;
+    }
+
+    ScriptProbeKey key { .scriptPath = ConvertUtf8ToWide(fields[0]), .pixelFormat = &*pixelFormatIter };
+    std::from_chars(fields[1].data(), fields[1].data() + fields[1].size(), key.scriptHash, 16);
+    std::from_chars(fields[2].data(), fields[2].data() + fields[2].size(), key.frameServerHash, 16);
+    std::from_chars(fields[4].data(), fields[4].data() + fields[4].size(), key.width);
+    std::from_chars(fields[5].data(), fields[5].data() + fields[5].size(), key.height);
+    std::from_chars(fields[6].data(), fields[6].data() + fields[6].size(), key.avgFrameDuration);
+    key.ignoreDisconnect = fields[7] == "1";
+
+    std::vector<BYTE> resultBytes(fields[8].size() / 2);
+    for (size_t i = 0; i < resultBytes.size(); ++i) {
+        std::from_chars(fields[8].data() + i * 2, fields[8].data() + i * 2 + 2, resultBytes[i], 16);
+    }
+
+    return std::make_pair(std::move(key), std::move(resultBytes));
+}
+
+ScriptProbeCache::CacheFileLock::CacheFileLock()
+    : _mutex(CreateMutexW(nullptr, FALSE, PROBE_CACHE_MUTEX_NAME)) {
+    // an abandoned mutex is owned all the same. The incomplete lines left by the crashed process are dropped on the next store
+    if (_mutex != nullptr) {
+        WaitForSingleObject(_mutex, INFINITE);
+    }
+}
+
+ScriptProbeCache::CacheFileLock::~CacheFileLock() {
+    if (_mutex != nullptr) {
+        ReleaseMutex(_mutex);
+        CloseHandle(_mutex);
+    }
+}
+
+}
@@ -0,0 +1,97 @@
+// License: https://github.com/CrendKing/avisynth_filter/blob/master/LICENSE
+
+#pragma once
+
+#include "format.h"
+#include "macros.h"
+
+
+namespace SynthFilter {
+
+/**
+ * Everything a script probe by the auxiliary frameserver depends on: the script itself, the frameserver with its plugins and the properties of the source clip.
+ * Probes with equal keys are expected to produce the same script clip, so their results can be reused.
+ * Only the main script file is hashed. Files it imports are not tracked, so editing an imported file alone does not invalidate the results.
+ * Scripts reading the path of the video source are not keyed, since their results may differ for every source file.
+ */
+struct ScriptProbeKey {
+    static auto Create(const std::filesystem::path &scriptPath, uint64_t frameServerHash, const AM_MEDIA_TYPE &mediaType, bool ignoreDisconnect, std::string_view sourcePathName) -> std::optional<ScriptProbeKey>;
+    static auto HashFrameServer(std::string_view versionString, const std::vector<std::filesystem::path> &pluginPaths) -> uint64_t;
+
+    auto operator<=>(const ScriptProbeKey &other) const = default;
+
+    std::filesystem::path scriptPath;
+    uint64_t scriptHash;
+    uint64_t frameServerHash;
+    const Format::PixelFormat *pixelFormat;
+    int width;
+    int height;
+    REFERENCE_TIME avgFrameDuration;
+    bool ignoreDisconnect;
+};
+
+/**
+ * Results of script probes, optionally persisted in the user profile so that a new player process skips the script evaluations
+ * for the media types seen before. The results are opaque to the cache and only need to be trivially copyable.
+ * The file only keeps the most recently stored results, and is rewritten as a whole on every store.
+ * The persisted results are discarded whenever the version of the filter or of the frameserver changes.
+ */
+class ScriptProbeCache {
+public:
+    CTOR_WITHOUT_COPYING(ScriptProbeCache)
+
+    auto Load(std::string_view frameServerVersion) -> void;
+
+    template <typename Result>
+    auto Find(const ScriptProbeKey &key) const -> std::optional<Result> {
+        const std::shared_lock lock(_mutex);
+
+        const auto iter = _results.find(key);
+        if (iter == _results.end() || iter->second.size() != sizeof(Result)) {
+            return std::nullopt;
+        }
+
+        Result result;
+        std::memcpy(&result, iter->second.data(), sizeof(Result));
+        return result;
+    }
+
+    template <typename Result>
+        requires std::is_trivially_copyable_v<Result>
+    auto Store(const ScriptProbeKey &key, const Result &result) -> void {
+        const BYTE *resultBytes = reinterpret_cast<const BYTE *>(&result);
+        StoreBytes(key, std::vector<BYTE>(resultBytes, resultBytes + sizeof(Result)));
+    }
+
+private:
+    /**
+     * Serializes the player processes reading and rewriting the cache file.
+     */
+    class CacheFileLock {
+    public:
+        CacheFileLock();
+        ~CacheFileLock();
+
+        DISABLE_COPYING(CacheFileLock)
+
+    private:
+        HANDLE _mutex;
+    };
+
+    static auto ParseEntry(std::string_view line) -> std::optional<std::pair<ScriptProbeKey, std::vector<BYTE>>>;
+
+    auto StoreBytes(const ScriptProbeKey &key, std::vector<BYTE> resultBytes) -> void;
+    auto ReadCacheFile() const -> std::vector<std::string>;
+
+    std::map<ScriptProbeKey, std::vector<BYTE>> _results;
+    bool _isLoaded = false;
+
+    // probes of different media types may run concurrently
+    mutable std::shared_mutex _mutex;
+
+    // empty when the results are not persisted
+    std::filesystem::path _cachePath;
+    std::string _versionHeader;
+};
+
+}
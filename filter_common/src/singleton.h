@@ -12,6 +12,7 @@ namespace SynthFilter {
  * This class is thread-safe, if:
  *   1. all Create() happen before all GetInstance();
  *   2. all Destroy() happen after all GetInstance();
+ *   3. threads using the instance concurrently to Replace() hold LockInstance() meanwhile.
  */
 template <typename T>
 class OnDemandSingleton {
@@ -35,9 +36,36 @@ public:
         _instance = nullptr;
     }
 
+    /*
+     * Publish an instance that is fully created elsewhere, e.g. on a background thread.
+     * Waits for the current holders of LockInstance(), so that nobody still uses the previous instance when this returns.
+     * onReplaced() runs before the holders of LockInstance() see the new instance, e.g. to move over what they share with the previous one.
+     * The previous instance is returned to the caller, who destroys it once nothing uses it any more.
+     */
+    template <typename F>
+    static auto Replace(std::unique_ptr<T> newInstance, F &&onReplaced) -> std::unique_ptr<T> {
+        const std::unique_lock lock(_replaceMutex);
+
+        std::unique_ptr<T> oldInstance(_instance.exchange(newInstance.release()));
+        onReplaced();
+        return oldInstance;
+    }
+
+    static auto Replace(std::unique_ptr<T> newInstance) -> std::unique_ptr<T> {
+        return Replace(std::move(newInstance), []() -> void {});
+    }
+
+    /*
+     * Must not be held while waiting for the thread that calls Replace(), nor acquired again by the same thread.
+     */
+    [[nodiscard]] static auto LockInstance() -> std::shared_lock<std::shared_mutex> {
+        return std::shared_lock(_replaceMutex);
+    }
+
 private:
     static inline std::atomic<T *> _instance = nullptr;
     static inline std::mutex _mutex;
+    static inline std::shared_mutex _replaceMutex;
 };
 
 }
@@ -0,0 +1,150 @@
+// License: https://github.com/CrendKing/avisynth_filter/blob/master/LICENSE
+
+#include "source_frame_spill.h"
+
+#include "environment.h"
+
+
+namespace SynthFilter {
+
+SourceFrameSpill::~SourceFrameSpill() {
+    Clear();
+
+    if (_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(_file);
+    }
+}
+
+auto SourceFrameSpill::Clear() -> void {
+    if (_mapping != nullptr) {
+        CloseHandle(_mapping);
+        _mapping = nullptr;
+    }
+
+    // give the disk space back, the file itself is reused by the next spill
+    if (_file != INVALID_HANDLE_VALUE) {
+        SetFilePointerEx(_file, {}, nullptr, FILE_BEGIN);
+        SetEndOfFile(_file);
+    }
+
+    _slotSize = 0;
+    _numSlots = 0;
+    _freeSlots.clear();
+    _numSpills = 0;
+    _numRefills = 0;
+}
+
+auto SourceFrameSpill::Store(const std::array<const BYTE *, 3> &srcSlices, const std::array<int, 3> &srcStrides, const std::array<int, 3> &rowSizes, const std::array<int, 3> &heights) -> std::optional<int> {
+    size_t frameSize = 0;
+    for (int plane = 0; plane < 3; ++plane) {
+        frameSize += static_cast<size_t>(rowSizes[plane]) * heights[plane];
+    }
+
+    const std::optional<int> optSlot = AllocateSlot(frameSize);
+    if (!optSlot) {
+        return std::nullopt;
+    }
+
+    BYTE *slotBuffer = MapSlot(*optSlot);
+    if (slotBuffer == nullptr) {
+        _freeSlots.emplace_back(*optSlot);
+        return std::nullopt;
+    }
+
+    BYTE *dst = slotBuffer;
+    for (int plane = 0; plane < 3; ++plane) {
+        for (int y = 0; y < heights[plane]; ++y) {
+            std::memcpy(dst, srcSlices[plane] + static_cast<ptrdiff_t>(y) * srcStrides[plane], rowSizes[plane]);
+            dst += rowSizes[plane];
+        }
+    }
+
+    UnmapViewOfFile(slotBuffer);
+    _numSpills += 1;
+
+    return optSlot;
+}
+
+auto SourceFrameSpill::Load(int slot, const std::array<BYTE *, 3> &dstSlices, const std::array<int, 3> &dstStrides, const std::array<int, 3> &rowSizes, const std::array<int, 3> &heights) -> bool {
+    BYTE *slotBuffer = MapSlot(slot);
+    if (slotBuffer == nullptr) {
+        return false;
+    }
+
+    const BYTE *src = slotBuffer;
+    for (int plane = 0; plane < 3; ++plane) {
+        for (int y = 0; y < heights[plane]; ++y) {
+            std::memcpy(dstSlices[plane] + static_cast<ptrdiff_t>(y) * dstStrides[plane], src, rowSizes[plane]);
+            src += rowSizes[plane];
+        }
+    }
+
+    UnmapViewOfFile(slotBuffer);
+    Discard(slot);
+    _numRefills += 1;
+
+    return true;
+}
+
+auto SourceFrameSpill::Discard(int slot) -> void {
+    _freeSlots.emplace_back(slot);
+}
+
+auto SourceFrameSpill::AllocateSlot(size_t frameSize) -> std::optional<int> {
+    if (_slotSize == 0) {
+        // views can only be mapped at offsets of the allocation granularity
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        _slotSize = FFALIGN(frameSize, static_cast<size_t>(systemInfo.dwAllocationGranularity));
+    } else if (frameSize > _slotSize) {
+        return std::nullopt;
+    }
+
+    if (_freeSlots.empty()) {
+        if (_file == INVALID_HANDLE_VALUE) {
+            std::array<WCHAR, MAX_PATH + 1> tempDir;
+            std::array<WCHAR, MAX_PATH> tempPath;
+            if (GetTempPathW(static_cast<DWORD>(tempDir.size()), tempDir.data()) == 0 || GetTempFileNameW(tempDir.data(), L"avf", 0, tempPath.data()) == 0) {
+                return std::nullopt;
+            }
+
+            _file = CreateFileW(tempPath.data(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+            if (_file == INVALID_HANDLE_VALUE) {
+                Environment::GetInstance().Log(L"Unable to create source frame spill file: %ls", tempPath.data());
+                return std::nullopt;
+            }
+
+            Environment::GetInstance().Log(L"Created source frame spill file: %ls", tempPath.data());
+        }
+
+        // the file mapping can not grow, so the file is remapped with twice the slots
+        const int newNumSlots = std::max(_numSlots * 2, 4);
+        const ULARGE_INTEGER mappingSize { .QuadPart = static_cast<ULONGLONG>(_slotSize) * newNumSlots };
+        const HANDLE newMapping = CreateFileMappingW(_file, nullptr, PAGE_READWRITE, mappingSize.HighPart, mappingSize.LowPart, nullptr);
+        if (newMapping == nullptr) {
+            Environment::GetInstance().Log(L"Unable to grow source frame spill file to %d slots", newNumSlots);
+            return std::nullopt;
+        }
+
+        if (_mapping != nullptr) {
+            CloseHandle(_mapping);
+        }
+        _mapping = newMapping;
+
+        for (int slot = newNumSlots - 1; slot >= _numSlots; --slot) {
+            _freeSlots.emplace_back(slot);
+        }
+        _numSlots = newNumSlots;
+    }
+
+    const int slot = _freeSlots.back();
+    _freeSlots.pop_back();
+    return slot;
+}
+
+auto SourceFrameSpill::MapSlot(int slot) const -> BYTE * {
+    const ULARGE_INTEGER offset { .QuadPart = static_cast<ULONGLONG>(_slotSize) * slot };
+    return static_cast<BYTE *>(MapViewOfFile(_mapping, FILE_MAP_READ | FILE_MAP_WRITE, offset.HighPart, offset.LowPart, _slotSize));
+}
+
+}
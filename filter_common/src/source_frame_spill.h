@@ -0,0 +1,41 @@
+// License: https://github.com/CrendKing/avisynth_filter/blob/master/LICENSE
+
+#pragma once
+
+#include "macros.h"
+
+
+namespace SynthFilter {
+
+/**
+ * Scratch file of source frames that are paged out of memory, one fixed size slot per frame.
+ * Each slot is only mapped into the address space while the frame is being written or read back,
+ * so that the 32-bit build can buffer far more frames than its address space allows.
+ */
+class SourceFrameSpill {
+public:
+    CTOR_WITHOUT_COPYING(SourceFrameSpill)
+    ~SourceFrameSpill();
+
+    auto Clear() -> void;
+    auto Store(const std::array<const BYTE *, 3> &srcSlices, const std::array<int, 3> &srcStrides, const std::array<int, 3> &rowSizes, const std::array<int, 3> &heights) -> std::optional<int>;
+    auto Load(int slot, const std::array<BYTE *, 3> &dstSlices, const std::array<int, 3> &dstStrides, const std::array<int, 3> &rowSizes, const std::array<int, 3> &heights) -> bool;
+    auto Discard(int slot) -> void;
+    constexpr auto GetNumSpills() const -> int { return _numSpills; }
+    constexpr auto GetNumRefills() const -> int { return _numRefills; }
+
+private:
+    auto AllocateSlot(size_t frameSize) -> std::optional<int>;
+    auto MapSlot(int slot) const -> BYTE *;
+
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    HANDLE _mapping = nullptr;
+    size_t _slotSize = 0;
+    int _numSlots = 0;
+    std::vector<int> _freeSlots;
+
+    int _numSpills = 0;
+    int _numRefills = 0;
+};
+
+}
@@ -0,0 +1,39 @@
+// License: https://github.com/CrendKing/avisynth_filter/blob/master/LICENSE
+
+#include "thread_budget.h"
+
+#include "constants.h"
+#include "environment.h"
+
+
+namespace SynthFilter {
+
+/**
+ * Number of logical cores this filter instance may keep busy. 0 in the settings means all of them.
+ */
+auto ThreadBudget::GetBudget() -> int {
+    const int numLogicalCores = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+    const int configuredBudget = Environment::GetInstance().GetThreadBudget();
+    return configuredBudget == 0 ? numLogicalCores : std::min(configuredBudget, numLogicalCores);
+}
+
+/**
+ * Threads left for the frameserver after the worker and the ingestion thread, at least one.
+ */
+auto ThreadBudget::GetFrameServerThreads() -> int {
+    return std::max(GetBudget() - NUM_FILTER_THREADS, 1);
+}
+
+auto ThreadBudget::PinCurrentThread(DWORD_PTR affinityMask, std::wstring_view stageName) -> void {
+    if (affinityMask == 0) {
+        return;
+    }
+
+    if (SetThreadAffinityMask(GetCurrentThread(), affinityMask) == 0) {
+        Environment::GetInstance().Log(L"Unable to set %ls thread affinity to %#zx", stageName.data(), affinityMask);
+    } else {
+        Environment::GetInstance().Log(L"Set %ls thread affinity to %#zx", stageName.data(), affinityMask);
+    }
+}
+
+}
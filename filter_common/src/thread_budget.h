@@ -0,0 +1,19 @@
+// License: https://github.com/CrendKing/avisynth_filter/blob/master/LICENSE
+
+#pragma once
+
+
+namespace SynthFilter {
+
+/**
+ * Splits one configured budget of logical cores between the filter's own threads and the frameserver's threads,
+ * so that several filter instances on one host do not each claim every core.
+ */
+class ThreadBudget {
+public:
+    static auto GetBudget() -> int;
+    static auto GetFrameServerThreads() -> int;
+    static auto PinCurrentThread(DWORD_PTR affinityMask, std::wstring_view stageName) -> void;
+};
+
+}
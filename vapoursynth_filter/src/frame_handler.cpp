@@ -4,19 +4,18 @@
 
 #include "constants.h"
 #include "filter.h"
+#include "thread_budget.h"
 
 
 namespace SynthFilter {
 
 auto FrameHandler::AddInputSample(IMediaSample *inputSample) -> HRESULT {
-    HRESULT hr;
-
     _addInputSampleCv.wait(_filter.m_csReceive, [this]() -> bool {
         if (_isFlushing) {
             return true;
         }
 
-        if (_nextSourceFrameNb <= Environment::GetInstance().GetInitialSrcBuffer()) {
+        if (_nextSourceFrameNb <= _initialSrcBuffer) {
             return true;
         }
 
@@ -27,7 +26,7 @@ auto FrameHandler::AddInputSample(IMediaSample *inputSample) -> HRESULT {
             return true;
         }
 
-        return _nextSourceFrameNb <= _lastUsedSourceFrameNb + Environment::GetInstance().GetInitialSrcBuffer() + NUM_SRC_FRAMES_PER_PROCESSING;
+        return _nextSourceFrameNb <= _lastUsedSourceFrameNb + _initialSrcBuffer + NUM_SRC_FRAMES_PER_PROCESSING;
     });
 
     if (_isFlushing || _isStopping) {
@@ -35,52 +34,140 @@ auto FrameHandler::AddInputSample(IMediaSample *inputSample) -> HRESULT {
         return S_FALSE;
     }
 
-    if ((_filter._isInputMediaTypeChanged || _filter._needReloadScript) && !ChangeOutputFormat()) {
+    if ((_filter._isInputMediaTypeChanged || (_filter._needReloadScript && !PrepareScriptSwap())) && !ChangeOutputFormat()) {
         return S_FALSE;
     }
 
+    if (_nextSourceFrameNb == 0) {
+        UpdateIngestionQueueDepth();
+
+        // by default, keep as many requests in flight as the core has threads to work on them
+        _maxInFlightOutputFrames = Environment::GetInstance().GetMaxInFlightOutputFrames();
+        if (_maxInFlightOutputFrames == 0) {
+            VSCoreInfo coreInfo;
+            AVSF_VPS_API->getCoreInfo(MainFrameServer::GetInstance().GetVsCore(), &coreInfo);
+            _maxInFlightOutputFrames = std::max(coreInfo.numThreads, 1);
+        }
+
+        UpdateDeliverySamplePoolSize();
+
+        // latch the pre-buffer size before the script could be re-evaluated in the background
+        _initialSrcBuffer = GetInitialSrcBuffer();
+
+        // a script surviving a warm flush needs no reload
+        if (!MainFrameServer::GetInstance().IsScriptActive()) {
+            StartScriptReload();
+        }
+    }
+
     REFERENCE_TIME inputSampleStartTime;
     REFERENCE_TIME inputSampleStopTime = 0;
     if (inputSample->GetTime(&inputSampleStartTime, &inputSampleStopTime) == VFW_E_SAMPLE_TIME_NOT_SET) {
         // for samples without start time, always treat as fixed frame rate
-        inputSampleStartTime = _nextSourceFrameNb * MainFrameServer::GetInstance().GetSourceAvgFrameDuration();
+        // the main frameserver may still be evaluating the script, so take the frame rate from the input format
+        inputSampleStartTime = _nextSourceFrameNb * GetInputFrameDuration();
     }
 
-    {
-        const std::shared_lock sharedSourceLock(_sourceMutex);
+    // compare with the last accepted sample rather than the last stored frame, since the ingestion thread may not have caught up yet
+    if (const REFERENCE_TIME lastSampleStartTime = _lastSourceFrameStartTime; inputSampleStartTime <= lastSampleStartTime) {
+        Environment::GetInstance().Log(L"Reject input sample due to start time going backward: curr %10lld last %10lld", inputSampleStartTime, lastSampleStartTime);
+        return S_FALSE;
+    }
 
-        // since the key of _sourceFrames is frame number, which only strictly increases, rbegin() returns the last emplaced frame
-        if (const REFERENCE_TIME lastSampleStartTime = _sourceFrames.empty() ? -1 : _sourceFrames.rbegin()->second.startTime;
-            inputSampleStartTime <= lastSampleStartTime) {
-            Environment::GetInstance().Log(L"Reject input sample due to start time going backward: curr %10lld last %10lld", inputSampleStartTime, lastSampleStartTime);
-            return S_FALSE;
-        }
+    if (ShouldDropInputSample()) {
+        _numConsecutiveDroppedSourceFrames += 1;
+        _numDroppedSourceFrames += 1;
+        Environment::GetInstance().Log(L"Drop input sample at %10lld due to overload, total dropped %6d", inputSampleStartTime, _numDroppedSourceFrames);
+        return S_FALSE;
     }
 
     RefreshInputFrameRates(_nextSourceFrameNb);
 
-    BYTE *sampleBuffer;
-    hr = inputSample->GetPointer(&sampleBuffer);
-    if (FAILED(hr)) {
+    std::unique_ptr<HDRSideData> hdrSideData = ReadHDRSideData(inputSample);
+
+    // the frame conversion is done in the ingestion thread so that upstream can proceed with its next frame as early as possible
+    if (!QueueInputSample({ inputSample,
+                            _nextSourceFrameNb,
+                            inputSampleStartTime,
+                            inputSampleStopTime,
+                            _filter.m_pInput->SampleProps()->dwTypeSpecificFlags,
+                            _numConsecutiveDroppedSourceFrames,
+                            _filter._inputVideoFormat,
+                            std::move(hdrSideData) })) {
         return S_FALSE;
     }
+    _numConsecutiveDroppedSourceFrames = 0;
+
+    Environment::GetInstance().Log(L"Queue source frame: %6d at %10lld ~ %10lld duration(literal) %10lld, last_used %6d, extra_buffer %6d",
+                                   _nextSourceFrameNb,
+                                   inputSampleStartTime,
+                                   inputSampleStopTime,
+                                   inputSampleStopTime - inputSampleStartTime,
+                                   _lastUsedSourceFrameNb.load(),
+                                   _extraSrcBuffer);
+    _nextSourceFrameNb += 1;
+    _lastSourceFrameStartTime = inputSampleStartTime;
+
+    // beyond the initial buffer, the input path reads the source window and frame rate of the evaluated script
+    if (_nextSourceFrameNb == _initialSrcBuffer) {
+        if (!WaitForScriptReload()) {
+            _filter.AbortPlayback(VFW_E_RUNTIME_ERROR);
+            return VFW_E_RUNTIME_ERROR;
+        }
 
-    VSFrame *frame = Format::CreateFrame(_filter._inputVideoFormat, sampleBuffer);
-    VSMap *frameProps = AVSF_VPS_API->getFramePropertiesRW(frame);
+        // only now the lookahead declared by the freshly evaluated script is known
+        _initialSrcBuffer = GetInitialSrcBuffer();
+    }
 
-    AVSF_VPS_API->mapSetFloat(frameProps, FRAME_PROP_NAME_ABS_TIME, inputSampleStartTime / static_cast<double>(UNITS), maReplace);
-    AVSF_VPS_API->mapSetInt(frameProps, "_SARNum", _filter._inputVideoFormat.pixelAspectRatioNum, maReplace);
-    AVSF_VPS_API->mapSetInt(frameProps, "_SARDen", _filter._inputVideoFormat.pixelAspectRatioDen, maReplace);
-    AVSF_VPS_API->mapSetInt(frameProps, FRAME_PROP_NAME_SOURCE_FRAME_NB, _nextSourceFrameNb, maReplace);
+    return S_OK;
+}
 
-    if (const std::optional<int> &optColorRange = _filter._inputVideoFormat.colorSpaceInfo.colorRange) {
+auto FrameHandler::IngestInputSample(InputSampleInfo &inputSampleInfo) -> void {
+    BYTE *sampleBuffer;
+    if (FAILED(inputSampleInfo.sample->GetPointer(&sampleBuffer))) {
+        return;
+    }
+
+    const bool isDuplicate = Environment::GetInstance().IsDuplicateFrameDetectionEnabled()
+        && DetectDuplicateSourceFrame(sampleBuffer, inputSampleInfo.sample->GetActualDataLength());
+
+    // the core of the input format may already be swapped out, and the current one must not be swapped until the frame is stored
+    std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+    inputSampleInfo.videoFormat.frameServerCore = MainFrameServer::GetInstance().GetVsCore();
+
+    VSFrame *frame = nullptr;
+    if (isDuplicate && Environment::GetInstance().IsDuplicateFrameReuseEnabled()) {
+        // share the buffer of the previous source frame to skip the conversion, with its own copy of the frame properties
+        const std::shared_lock sharedSourceLock(_sourceMutex);
+
+        if (const auto iter = _sourceFrames.find(inputSampleInfo.frameNb - 1); iter != _sourceFrames.end() && !iter->second.spillSlot) {
+            frame = AVSF_VPS_API->copyFrame(iter->second.autoFrame.frame, inputSampleInfo.videoFormat.frameServerCore);
+        }
+    }
+
+    VSMap *frameProps;
+    if (frame != nullptr) {
+        frameProps = AVSF_VPS_API->getFramePropertiesRW(frame);
+        AVSF_VPS_API->mapDeleteKey(frameProps, FRAME_PROP_NAME_DURATION_NUM);
+        AVSF_VPS_API->mapDeleteKey(frameProps, FRAME_PROP_NAME_DURATION_DEN);
+    } else {
+        frame = Format::CreateFrame(inputSampleInfo.videoFormat, sampleBuffer);
+        frameProps = AVSF_VPS_API->getFramePropertiesRW(frame);
+    }
+
+    AVSF_VPS_API->mapSetFloat(frameProps, FRAME_PROP_NAME_ABS_TIME, inputSampleInfo.startTime / static_cast<double>(UNITS), maReplace);
+    AVSF_VPS_API->mapSetInt(frameProps, "_SARNum", inputSampleInfo.videoFormat.pixelAspectRatioNum, maReplace);
+    AVSF_VPS_API->mapSetInt(frameProps, "_SARDen", inputSampleInfo.videoFormat.pixelAspectRatioDen, maReplace);
+    AVSF_VPS_API->mapSetInt(frameProps, FRAME_PROP_NAME_SOURCE_FRAME_NB, inputSampleInfo.frameNb, maReplace);
+
+    if (const std::optional<int> &optColorRange = inputSampleInfo.videoFormat.colorSpaceInfo.colorRange) {
         AVSF_VPS_API->mapSetInt(frameProps, "_ColorRange", *optColorRange, maReplace);
     }
-    AVSF_VPS_API->mapSetInt(frameProps, "_Primaries", _filter._inputVideoFormat.colorSpaceInfo.primaries, maReplace);
-    AVSF_VPS_API->mapSetInt(frameProps, "_Matrix", _filter._inputVideoFormat.colorSpaceInfo.matrix, maReplace);
-    AVSF_VPS_API->mapSetInt(frameProps, "_Transfer", _filter._inputVideoFormat.colorSpaceInfo.transfer, maReplace);
+    AVSF_VPS_API->mapSetInt(frameProps, "_Primaries", inputSampleInfo.videoFormat.colorSpaceInfo.primaries, maReplace);
+    AVSF_VPS_API->mapSetInt(frameProps, "_Matrix", inputSampleInfo.videoFormat.colorSpaceInfo.matrix, maReplace);
+    AVSF_VPS_API->mapSetInt(frameProps, "_Transfer", inputSampleInfo.videoFormat.colorSpaceInfo.transfer, maReplace);
 
-    const DWORD typeSpecificFlags = _filter.m_pInput->SampleProps()->dwTypeSpecificFlags;
+    const DWORD typeSpecificFlags = inputSampleInfo.typeSpecificFlags;
     const int rfpFieldBased = [&]() {
         if (typeSpecificFlags & AM_VIDEO_FLAG_WEAVE) {
             return VSFieldBased::VSC_FIELD_PROGRESSIVE;
@@ -93,39 +180,25 @@ auto FrameHandler::AddInputSample(IMediaSample *inputSample) -> HRESULT {
     AVSF_VPS_API->mapSetInt(frameProps, FRAME_PROP_NAME_FIELD_BASED, rfpFieldBased, maReplace);
     AVSF_VPS_API->mapSetInt(frameProps, FRAME_PROP_NAME_TYPE_SPECIFIC_FLAGS, typeSpecificFlags, maReplace);
 
-    std::unique_ptr<HDRSideData> hdrSideData = std::make_unique<HDRSideData>();
-    {
-        if (const ATL::CComQIPtr<IMediaSideData> inputSampleSideData(inputSample); inputSampleSideData != nullptr) {
-            hdrSideData->ReadFrom(inputSampleSideData);
-
-            if (const std::optional<const BYTE *> optHdr = hdrSideData->GetHDRData()) {
-                _filter._inputVideoFormat.hdrType = 1;
+    if (Environment::GetInstance().IsAdmissionControlEnabled()) {
+        AVSF_VPS_API->mapSetInt(frameProps, FRAME_PROP_NAME_NUM_DROPPED_FRAMES, inputSampleInfo.numDroppedFramesBefore, maReplace);
+    }
 
-                if (const std::optional<const BYTE *> optHdrCll = hdrSideData->GetHDRContentLightLevelData()) {
-                    _filter._inputVideoFormat.hdrLuminance = reinterpret_cast<const MediaSideDataHDRContentLightLevel *>(*optHdrCll)->MaxCLL;
-                } else {
-                    _filter._inputVideoFormat.hdrLuminance = static_cast<int>(reinterpret_cast<const MediaSideDataHDR *>(*optHdr)->max_display_mastering_luminance);
-                }
-            }
-        }
+    if (Environment::GetInstance().IsDuplicateFrameDetectionEnabled()) {
+        AVSF_VPS_API->mapSetInt(frameProps, FRAME_PROP_NAME_DUPLICATE_FRAME, isDuplicate, maReplace);
     }
 
     {
         const std::unique_lock uniqueSourceLock(_sourceMutex);
 
         _sourceFrames.emplace(std::piecewise_construct,
-                              std::forward_as_tuple(_nextSourceFrameNb),
-                              std::forward_as_tuple(frame, inputSampleStartTime, std::move(hdrSideData)));
-        Environment::GetInstance().Log(L"Store source frame: %6d at %10lld ~ %10lld duration(literal) %10lld, last_used %6d, extra_buffer %6d",
-                                       _nextSourceFrameNb,
-                                       inputSampleStartTime,
-                                       inputSampleStopTime,
-                                       inputSampleStopTime - inputSampleStartTime,
-                                       _lastUsedSourceFrameNb.load(),
-                                       _extraSrcBuffer);
+                              std::forward_as_tuple(inputSampleInfo.frameNb),
+                              std::forward_as_tuple(frame, inputSampleInfo.startTime, std::move(inputSampleInfo.hdrSideData)));
+        Environment::GetInstance().Log(L"Store source frame: %6d", inputSampleInfo.frameNb);
 
-        _nextSourceFrameNb += 1;
+        SpillSourceFrames(_nextProcessSourceFrameNb, _nextProcessSourceFrameNb, _nextProcessSourceFrameNb);
     }
+    frameServerLock.unlock();
 
     /*
      * Some video decoders set the correct start time but the wrong stop time (stop time always being start time + average frame time).
@@ -140,7 +213,7 @@ auto FrameHandler::AddInputSample(IMediaSample *inputSample) -> HRESULT {
 
         for (int i = 0; i < NUM_SRC_FRAMES_PER_PROCESSING; ++i) {
             if (processSourceFrameIters[i] == _sourceFrames.end()) {
-                return S_OK;
+                return;
             }
 
             if (i < NUM_SRC_FRAMES_PER_PROCESSING - 1) {
@@ -151,43 +224,286 @@ auto FrameHandler::AddInputSample(IMediaSample *inputSample) -> HRESULT {
     }
     _nextProcessSourceFrameNb = processSourceFrameIters[1]->first;
 
-    frameProps = AVSF_VPS_API->getFramePropertiesRW(processSourceFrameIters[0]->second.autoFrame.frame);
-    REFERENCE_TIME frameDurationNum = processSourceFrameIters[1]->second.startTime - processSourceFrameIters[0]->second.startTime;
-    REFERENCE_TIME frameDurationDen = UNITS;
-    CoprimeIntegers(frameDurationNum, frameDurationDen);
-    AVSF_VPS_API->mapSetInt(frameProps, FRAME_PROP_NAME_DURATION_NUM, frameDurationNum, maReplace);
-    AVSF_VPS_API->mapSetInt(frameProps, FRAME_PROP_NAME_DURATION_DEN, frameDurationDen, maReplace);
+    {
+        // a spilled frame could be paged back in concurrently, which replaces the frame carrying the properties
+        const std::unique_lock uniqueSourceLock(_sourceMutex);
+
+        frameProps = AVSF_VPS_API->getFramePropertiesRW(processSourceFrameIters[0]->second.autoFrame.frame);
+        REFERENCE_TIME frameDurationNum = processSourceFrameIters[1]->second.startTime - processSourceFrameIters[0]->second.startTime;
+        REFERENCE_TIME frameDurationDen = UNITS;
+        CoprimeIntegers(frameDurationNum, frameDurationDen);
+        AVSF_VPS_API->mapSetInt(frameProps, FRAME_PROP_NAME_DURATION_NUM, frameDurationNum, maReplace);
+        AVSF_VPS_API->mapSetInt(frameProps, FRAME_PROP_NAME_DURATION_DEN, frameDurationDen, maReplace);
+    }
     _newSourceFrameCv.notify_all();
 
     // delay activating the main frameserver until we have enough pre-buffered frames in store
-    if (_nextSourceFrameNb < Environment::GetInstance().GetInitialSrcBuffer()) {
-        return S_OK;
-    } else if (_nextSourceFrameNb == Environment::GetInstance().GetInitialSrcBuffer()) {
-        MainFrameServer::GetInstance().ReloadScript(_filter.m_pInput->CurrentMediaType(), true);
+    if (!_isMainScriptReady) {
+        // a failed evaluation is reported by the input path
+        if (inputSampleInfo.frameNb + 1 < _initialSrcBuffer || !WaitForScriptReload()) {
+            return;
+        }
+
+        _isMainScriptReady = true;
+    }
+
+    {
+        const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+        const std::unique_lock outputRequestLock(_outputRequestMutex);
+
+        _maxRequestOutputFrameNb = static_cast<int>(llMulDiv(processSourceFrameIters[0]->first,
+                                                             MainFrameServer::GetInstance().GetSourceAvgFrameDuration(),
+                                                             MainFrameServer::GetInstance().GetScriptAvgFrameDuration(),
+                                                             0));
+    }
+    RequestOutputFrames();
+}
+
+/**
+ * Request the requestable output frames in the order of their delivery, while keeping at most _maxInFlightOutputFrames requests in flight.
+ * This is called both when new source frames arrive and when in-flight requests complete.
+ * Callers never wait for each other. If another thread is already requesting, it repeats the requests on behalf of this caller.
+ */
+auto FrameHandler::RequestOutputFrames() -> void {
+    _outputRequestEpoch += 1;
+
+    while (true) {
+        std::unique_lock outputRequestLock(_outputRequestMutex, std::try_to_lock);
+        if (!outputRequestLock.owns_lock()) {
+            return;
+        }
+
+        const int outputRequestEpoch = _outputRequestEpoch;
+        std::vector<int> requestFrameNbs;
+        VSNode *scriptClip = nullptr;
+
+        while (!_isFlushing
+               && _nextOutputFrameNb <= _maxRequestOutputFrameNb
+               && _nextOutputFrameNb < _nextDeliveryFrameNb + OUTPUT_FRAME_RING_SIZE
+               && !_isScriptSwapping
+               && _numInFlightOutputFrames < _maxInFlightOutputFrames) {
+            // before every async request to a frame, we need to keep track of the request so that when flushing we can wait for
+            // any pending request to finish before destroying the script
+            requestFrameNbs.emplace_back(_nextOutputFrameNb);
+
+            _nextOutputFrameNb += 1;
+            _numInFlightOutputFrames += 1;
+            *_numPendingOutputCallbacks += 1;
+        }
+
+        // the script could be stopped by a flush as soon as the lock is released, so hold our own reference
+        if (!requestFrameNbs.empty()) {
+            scriptClip = AVSF_VPS_API->addNodeRef(MainFrameServer::GetInstance().GetScriptClip());
+        }
+
+        outputRequestLock.unlock();
+
+        for (const int frameNb : requestFrameNbs) {
+            AVSF_VPS_API->getFrameAsync(_outputFrameNbBase + frameNb, scriptClip, VpsGetFrameCallback, this);
+        }
+
+        AVSF_VPS_API->freeNode(scriptClip);
+
+        // no other caller gave up on the lock since the requests were evaluated
+        if (_outputRequestEpoch == outputRequestEpoch) {
+            return;
+        }
+    }
+}
+
+/**
+ * Replace the main script at the next requested output frame. The frames requested from the old script are still delivered.
+ * The new script has the same output format, so the buffered source frames and the frame numbers carry over.
+ */
+auto FrameHandler::SwapScript() -> void {
+    {
+        const std::unique_lock outputRequestLock(_outputRequestMutex);
+
+        _isScriptSwapping = true;
+    }
+
+    // the requests in flight read source frames through the main frameserver, which must not change under them
+    for (int numPendingOutputCallbacks; (numPendingOutputCallbacks = *_numPendingOutputCallbacks) > 0;) {
+        _numPendingOutputCallbacks->wait(numPendingOutputCallbacks);
+    }
+
+    // the frames already allocated by the old core keep its memory alive after the core is freed
+    RetireMainFrameServer(MainFrameServer::Replace(std::move(_scriptSwapFrameServer)));
+    Environment::GetInstance().Log(L"Swap script at output frame %6d", _nextOutputFrameNb);
+
+    {
+        const std::unique_lock outputRequestLock(_outputRequestMutex);
+
+        _isScriptSwapping = false;
     }
 
-    const int maxRequestOutputFrameNb = static_cast<int>(llMulDiv(processSourceFrameIters[0]->first,
-                                                                  MainFrameServer::GetInstance().GetSourceAvgFrameDuration(),
-                                                                  MainFrameServer::GetInstance().GetScriptAvgFrameDuration(),
-                                                                  0));
-    while (_nextOutputFrameNb <= maxRequestOutputFrameNb) {
-        // before every async request to a frame, we need to keep track of the request so that when flushing we can wait for
-        // any pending request to finish before destroying the script
+    RequestOutputFrames();
+}
+
+auto FrameHandler::UpdateDeliverySamplePoolSize() -> void {
+    // the renderer may hold on to the last delivered sample, and the callbacks may attach every pooled sample to later frames
+    // keep one more downstream buffer out of the pool, so that the worker can always acquire a sample for the frame in order
+    _maxHeldDeliverySamples = std::min(std::max(static_cast<int>(_filter._numOutputBuffers) - 2, 0), _maxInFlightOutputFrames);
 
-        {
-            const std::unique_lock uniqueOutputLock(_outputMutex);
+    Environment::GetInstance().Log(L"Delivery sample pool size: %2d", _maxHeldDeliverySamples.load());
+}
 
-            _outputFrames.emplace(_nextOutputFrameNb, nullptr);
+/**
+ * Fill the pool of delivery samples for the callback threads to convert output frames into.
+ * Only the worker acquires delivery samples, so that a sample carrying a new media type is seen in the order of delivery.
+ */
+auto FrameHandler::PrefetchDeliverySamples() -> void {
+    while (_formatChangeDeliverySample == nullptr && _numHeldDeliverySamples < _maxHeldDeliverySamples) {
+        ATL::CComPtr<IMediaSample> deliverySample;
+
+        // never block here, since the downstream may not release any buffer until the next frame is delivered
+        if (FAILED(_filter.m_pOutput->GetDeliveryBuffer(&deliverySample, nullptr, nullptr, AM_GBF_NOWAIT))) {
+            deliverySample.Detach();
+            break;
         }
-        AVSF_VPS_API->getFrameAsync(_nextOutputFrameNb, MainFrameServer::GetInstance().GetScriptClip(), VpsGetFrameCallback, this);
 
-        _nextOutputFrameNb += 1;
+        _numHeldDeliverySamples += 1;
+
+        // frames converted ahead are in the current format, so the new one must wait until the frame this sample is used for
+        if (AM_MEDIA_TYPE *pmtOut; deliverySample->GetMediaType(&pmtOut) == S_OK) {
+            DeleteMediaType(pmtOut);
+            _formatChangeDeliverySample.Attach(deliverySample.Detach());
+            break;
+        }
+
+        ProbeOutputBufferTemporalFlags(deliverySample);
+
+        const std::unique_lock poolLock(_deliverySamplePoolMutex);
+
+        _deliverySamplePool.emplace_back(deliverySample);
     }
+}
 
-    return S_OK;
+/**
+ * Convert the output frame into a pooled delivery sample on the callback thread, so that the conversions of different frames run in parallel.
+ * If the pool is empty, the frame is left for the worker to convert.
+ */
+auto FrameHandler::ConvertOutputFrameAhead(OutputFrameSlot &outputFrameSlot, int outputFrameNb, const VSFrame *outputFrame) -> void {
+    // the worker is about to skip the frame as late, so the conversion would be wasted
+    if (outputFrameNb <= _lateOutputFrameNbLimit) {
+        return;
+    }
+
+    ATL::CComPtr<IMediaSample> deliverySample;
+    int formatGeneration;
+
+    {
+        const std::unique_lock poolLock(_deliverySamplePoolMutex);
+
+        if (_deliverySamplePool.empty()) {
+            return;
+        }
+
+        deliverySample.Attach(_deliverySamplePool.back().Detach());
+        _deliverySamplePool.pop_back();
+        formatGeneration = _outputFormatGeneration;
+    }
+
+    const std::shared_lock sharedFormatLock(_outputFormatMutex);
+
+    BYTE *outputBuffer;
+    if (formatGeneration != _outputFormatGeneration || FAILED(deliverySample->GetPointer(&outputBuffer))) {
+        _numHeldDeliverySamples -= 1;
+        return;
+    }
+
+    Format::WriteSample(_filter._outputVideoFormat, outputFrame, outputBuffer);
+
+    outputFrameSlot.convertedSample.Attach(deliverySample.Detach());
+    outputFrameSlot.formatGeneration = formatGeneration;
+}
+
+/**
+ * Take a sample left in the pool for the frame in order, rather than blocking on the downstream while still holding it.
+ */
+auto FrameHandler::TakePooledDeliverySample(ATL::CComPtr<IMediaSample> &outSample) -> bool {
+    const std::unique_lock poolLock(_deliverySamplePoolMutex);
+
+    if (_deliverySamplePool.empty()) {
+        return false;
+    }
+
+    outSample.Attach(_deliverySamplePool.back().Detach());
+    _deliverySamplePool.pop_back();
+
+    return true;
+}
+
+auto FrameHandler::ReleaseDeliverySamples() -> void {
+    for (OutputFrameSlot &outputFrameSlot : _outputFrameRing) {
+        outputFrameSlot.convertedSample.Release();
+    }
+
+    {
+        const std::unique_lock poolLock(_deliverySamplePoolMutex);
+
+        _deliverySamplePool.clear();
+    }
+
+    _lastOutputFrame = nullptr;
+
+    // the media type attached to the sample is only announced once, so apply it before giving the sample back
+    if (_formatChangeDeliverySample != nullptr) {
+        if (AM_MEDIA_TYPE *pmtOut; _formatChangeDeliverySample->GetMediaType(&pmtOut) == S_OK) {
+            const std::shared_ptr<AM_MEDIA_TYPE> pmtOutPtr(pmtOut, &DeleteMediaType);
+            AcceptOutputMediaType(*pmtOut);
+        }
+
+        _formatChangeDeliverySample.Release();
+    }
+
+    _numHeldDeliverySamples = 0;
+}
+
+auto FrameHandler::ProbeOutputBufferTemporalFlags(IMediaSample *outSample) -> void {
+    if ((_filter._outputVideoFormat.outputBufferTemporalFlags & 0b11) != 0b01) {
+        return;
+    }
+
+    BYTE *outputBuffer;
+    if (FAILED(outSample->GetPointer(&outputBuffer))) {
+        return;
+    }
+
+    MEMORY_BASIC_INFORMATION dstBufferInfo;
+    VirtualQuery(outputBuffer, &dstBufferInfo, sizeof(dstBufferInfo));
+
+    const std::unique_lock uniqueFormatLock(_outputFormatMutex);
+
+    _filter._outputVideoFormat.outputBufferTemporalFlags |= (((dstBufferInfo.Protect & PAGE_WRITECOMBINE) != 0) << 2) + 0b10;
 }
 
+auto FrameHandler::AcceptOutputMediaType(const AM_MEDIA_TYPE &mediaType) -> void {
+    _filter.m_pOutput->SetMediaType(static_cast<const CMediaType *>(&mediaType));
+
+    {
+        const std::unique_lock uniqueFormatLock(_outputFormatMutex);
+        const std::unique_lock poolLock(_deliverySamplePoolMutex);
+
+        _filter._outputVideoFormat = Format::GetVideoFormat(mediaType, &MainFrameServer::GetInstance());
+
+        // samples converted ahead or pooled are sized and converted for the old format
+        _outputFormatGeneration += 1;
+        _numHeldDeliverySamples -= static_cast<int>(_deliverySamplePool.size());
+        _deliverySamplePool.clear();
+    }
+
+    _lastOutputFrame = nullptr;
+    _lastOutputData.clear();
+
+    _notifyChangedOutputMediaType = true;
+}
+
+/**
+ * Returns nullptr if the frame is drained or bad, which the frameserver replaces with its own dummy frame.
+ */
 auto FrameHandler::GetSourceFrame(int frameNb) -> const VSFrame * {
+    frameNb -= _sourceFrameNbBase;
     Environment::GetInstance().Log(L"Wait for source frame: frameNb %6d input queue size %2zd", frameNb, _sourceFrames.size());
 
     std::shared_lock sharedSourceLock(_sourceMutex);
@@ -210,13 +526,89 @@ auto FrameHandler::GetSourceFrame(int frameNb) -> const VSFrame * {
 
     if (_isFlushing) {
         Environment::GetInstance().Log(L"Drain for frame %6d", frameNb);
-        return FrameServerCommon::GetInstance().CreateSourceDummyFrame(MainFrameServer::GetInstance().GetVsCore());
+        return nullptr;
+    }
+
+    if (iter->second.spillSlot) {
+        // paging the frame back in modifies the source frames
+        sharedSourceLock.unlock();
+        return RefillSourceFrame(frameNb);
     }
 
     Environment::GetInstance().Log(L"Return source frame %6d", frameNb);
     return AVSF_VPS_API->addFrameRef(iter->second.autoFrame.frame);
 }
 
+auto FrameHandler::RefillSourceFrame(int frameNb) -> const VSFrame * {
+    // the frame is paged in with the core of the main frameserver
+    const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+    const std::unique_lock uniqueSourceLock(_sourceMutex);
+
+    // the frame could be refilled or garbage collected by others in the meantime
+    const auto iter = _sourceFrames.lower_bound(frameNb);
+    if (iter == _sourceFrames.end() || (iter->second.spillSlot && !PageInSourceFrame(iter->second))) {
+        Environment::GetInstance().Log(L"Bad frame %6d", frameNb);
+        return nullptr;
+    }
+
+    Environment::GetInstance().Log(L"Return refilled source frame %6d", frameNb);
+    const VSFrame *frame = AVSF_VPS_API->addFrameRef(iter->second.autoFrame.frame);
+
+    // the frame just paged in and the past window the script reads with it would otherwise be the first to be spilled again
+    SpillSourceFrames(_nextProcessSourceFrameNb, iter->first - MainFrameServer::GetInstance().GetSourcePastFrames(), iter->first);
+    return frame;
+}
+
+auto FrameHandler::PageOutSourceFrame(SourceFrameInfo &sourceFrame) -> bool {
+    const VSFrame *frame = sourceFrame.autoFrame.frame;
+    const VSVideoFormat *videoFormat = AVSF_VPS_API->getVideoFrameFormat(frame);
+
+    std::array<const BYTE *, 3> srcSlices {};
+    std::array<int, 3> srcStrides {};
+    std::array<int, 3> rowSizes {};
+    std::array<int, 3> heights {};
+    for (int plane = 0; plane < videoFormat->numPlanes; ++plane) {
+        srcSlices[plane] = AVSF_VPS_API->getReadPtr(frame, plane);
+        srcStrides[plane] = static_cast<int>(AVSF_VPS_API->getStride(frame, plane));
+        rowSizes[plane] = AVSF_VPS_API->getFrameWidth(frame, plane) * videoFormat->bytesPerSample;
+        heights[plane] = AVSF_VPS_API->getFrameHeight(frame, plane);
+    }
+    sourceFrame.spillSlot = _sourceFrameSpill.Store(srcSlices, srcStrides, rowSizes, heights);
+    if (!sourceFrame.spillSlot) {
+        return false;
+    }
+
+    // the frame properties of the source frame are still needed for the duration wait, keep them on a minimal frame
+    sourceFrame.autoFrame = AVSF_VPS_API->newVideoFrame(videoFormat, SPILLED_FRAME_CARRIER_DIMENSION, SPILLED_FRAME_CARRIER_DIMENSION, frame, MainFrameServer::GetInstance().GetVsCore());
+
+    return true;
+}
+
+auto FrameHandler::PageInSourceFrame(SourceFrameInfo &sourceFrame) -> bool {
+    const VSVideoInfo &videoInfo = _filter._inputVideoFormat.videoInfo;
+    VSFrame *frame = AVSF_VPS_API->newVideoFrame(&videoInfo.format, videoInfo.width, videoInfo.height, sourceFrame.autoFrame.frame, MainFrameServer::GetInstance().GetVsCore());
+
+    std::array<BYTE *, 3> dstSlices {};
+    std::array<int, 3> dstStrides {};
+    std::array<int, 3> rowSizes {};
+    std::array<int, 3> heights {};
+    for (int plane = 0; plane < videoInfo.format.numPlanes; ++plane) {
+        dstSlices[plane] = AVSF_VPS_API->getWritePtr(frame, plane);
+        dstStrides[plane] = static_cast<int>(AVSF_VPS_API->getStride(frame, plane));
+        rowSizes[plane] = AVSF_VPS_API->getFrameWidth(frame, plane) * videoInfo.format.bytesPerSample;
+        heights[plane] = AVSF_VPS_API->getFrameHeight(frame, plane);
+    }
+    if (!_sourceFrameSpill.Load(*sourceFrame.spillSlot, dstSlices, dstStrides, rowSizes, heights)) {
+        AVSF_VPS_API->freeFrame(frame);
+        return false;
+    }
+
+    sourceFrame.autoFrame = frame;
+    sourceFrame.spillSlot.reset();
+
+    return true;
+}
+
 auto FrameHandler::BeginFlush() -> void {
     Environment::GetInstance().Log(L"FrameHandler start BeginFlush()");
 
@@ -226,9 +618,17 @@ auto FrameHandler::BeginFlush() -> void {
     _isFlushing.wait(true);
     _isFlushing = true;
 
+    {
+        const std::unique_lock ingestionLock(_ingestionMutex);
+
+        _pendingInputSamples.clear();
+    }
+    _ingestionCv.notify_all();
+
     _addInputSampleCv.notify_all();
     _newSourceFrameCv.notify_all();
-    _deliverSampleCv.notify_all();
+    _outputFrameReadyEpoch += 1;
+    _outputFrameReadyEpoch.notify_all();
 
     Environment::GetInstance().Log(L"FrameHandler finish BeginFlush()");
 }
@@ -236,18 +636,28 @@ auto FrameHandler::BeginFlush() -> void {
 auto FrameHandler::EndFlush() -> void {
     Environment::GetInstance().Log(L"FrameHandler start EndFlush()");
 
-    {
-        std::shared_lock sharedOutputLock(_outputMutex);
+    // wait for all pending requests to finish before the script can be destroyed
+    for (int numPendingOutputCallbacks; (numPendingOutputCallbacks = *_numPendingOutputCallbacks) > 0;) {
+        _numPendingOutputCallbacks->wait(numPendingOutputCallbacks);
+    }
 
-        _flushOutputSampleCv.wait(sharedOutputLock, [this]() {
-            return std::ranges::all_of(_outputFrames | std::views::values, [](const VSFrame *frame) {
-                return frame != nullptr;
-            }, &AutoReleaseVSFrame::frame);
-        });
+    for (OutputFrameSlot &outputFrameSlot : _outputFrameRing) {
+        AVSF_VPS_API->freeFrame(outputFrameSlot.frame.exchange(nullptr));
+        outputFrameSlot.isFailed = false;
+    }
+
+    // a script swap that has not happened yet is taken over by the script reload of the new segment
+    if (_isScriptSwapPending.exchange(false)) {
+        _scriptSwapFrameServer.reset();
+        MainFrameServer::GetInstance().StopScript();
+    }
+
+    if (MainFrameServer::GetInstance().IsScriptActive() && !RebaseFrameNumbers()) {
+        MainFrameServer::GetInstance().StopScript();
     }
-    _outputFrames.clear();
 
     ResetInput();
+    ReleaseDeliverySamples();
 
     _isFlushing = false;
     _isFlushing.notify_all();
@@ -256,40 +666,62 @@ auto FrameHandler::EndFlush() -> void {
 }
 
 auto VS_CC FrameHandler::VpsGetFrameCallback(void *userData, const VSFrame *f, int n, VSNode *node, const char *errorMsg) -> void {
+    FrameHandler *frameHandler = static_cast<FrameHandler *>(userData);
+
+    // the frame handler could be destroyed as soon as the last pending callback is counted off, while the counter is kept alive by this reference
+    const std::shared_ptr<std::atomic<int>> numPendingOutputCallbacks = frameHandler->_numPendingOutputCallbacks;
+
+    frameHandler->_numInFlightOutputFrames -= 1;
+    n -= frameHandler->_outputFrameNbBase;
+
     if (f == nullptr) {
         Environment::GetInstance().Log(L"Fail to generate output frame %6d with message: %hs", n, errorMsg);
-        return;
+    } else {
+        Environment::GetInstance().Log(L"Output frame %6d is ready, in-flight requests %2d", n, frameHandler->_numInFlightOutputFrames.load());
     }
 
-    FrameHandler *frameHandler = static_cast<FrameHandler *>(userData);
-    Environment::GetInstance().Log(L"Output frame %6d is ready, output queue size %2zd", n, frameHandler->_outputFrames.size());
-
     if (frameHandler->_isFlushing) {
-        {
-            const std::unique_lock uniqueOutputLock(frameHandler->_outputMutex);
-
-            frameHandler->_outputFrames.erase(n);
-        }
         AVSF_VPS_API->freeFrame(f);
     } else {
-        {
-            const std::unique_lock uniqueOutputLock(frameHandler->_outputMutex);
-
-            frameHandler->_outputFrames[n] = const_cast<VSFrame *>(f);
+        // the slot is free since no frame is requested beyond the ring size from the next frame to deliver
+        OutputFrameSlot &outputFrameSlot = frameHandler->_outputFrameRing[n % OUTPUT_FRAME_RING_SIZE];
+        if (f == nullptr) {
+            outputFrameSlot.isFailed.store(true, std::memory_order_release);
+        } else {
+            frameHandler->ConvertOutputFrameAhead(outputFrameSlot, n, f);
+            outputFrameSlot.frame.store(f, std::memory_order_release);
         }
-        frameHandler->_deliverSampleCv.notify_all();
+        frameHandler->_outputFrameReadyEpoch += 1;
+        frameHandler->_outputFrameReadyEpoch.notify_all();
     }
 
-    frameHandler->_flushOutputSampleCv.notify_all();
+    // refill the in-flight window
+    frameHandler->RequestOutputFrames();
+
+    *numPendingOutputCallbacks -= 1;
+    numPendingOutputCallbacks->notify_all();
 }
 
 auto FrameHandler::ResetInput() -> void {
     _sourceFrames.clear();
+    _sourceFrameSpill.Clear();
 
     _nextSourceFrameNb = 0;
     _nextProcessSourceFrameNb = 0;
     _nextOutputFrameNb = 0;
+    _maxRequestOutputFrameNb = -1;
+    _numInFlightOutputFrames = 0;
+    _nextDeliveryFrameNb = 0;
+    _lastSourceFrameStartTime = -1;
+    _lastDeliveredFrameStartTime = -1;
+    _isOverloaded = false;
+    _numConsecutiveDroppedSourceFrames = 0;
+    _numDroppedSourceFrames = 0;
+    _lastSourceFrameHash.reset();
+    _numDuplicateSourceFrames = 0;
     _lastUsedSourceFrameNb = 0;
+    _isMainScriptReady = false;
+    _initialSrcBuffer = 0;
     _notifyChangedOutputMediaType = false;
 
     _frameRateCheckpointInputSampleNb = 0;
@@ -316,23 +748,48 @@ auto FrameHandler::PrepareOutputSample(ATL::CComPtr<IMediaSample> &outSample, in
     REFERENCE_TIME frameStartTime = _nextOutputFrameStartTime;
     REFERENCE_TIME frameStopTime = frameStartTime + frameDuration;
     _nextOutputFrameStartTime = frameStopTime;
+    _currentOutputLatency = std::max(_lastSourceFrameStartTime - frameStartTime, 0LL);
+
+    Environment::GetInstance().Log(L"Output frame: frameNb %6d startTime %10lld stopTime %10lld duration %10lld latency %10lld",
+                                   outputFrameNb,
+                                   frameStartTime,
+                                   frameStopTime,
+                                   frameDuration,
+                                   _currentOutputLatency);
+
+    // the timestamps are already advanced above, so a skipped frame leaves no gap for the following ones
+    if (ShouldSkipLateOutputFrame(outputFrameNb, frameStopTime)) {
+        // the following frames arrive on the callback threads before the worker sees them. Tell them how many of those are late as well
+        if (CRefTime streamTime; frameDuration > 0 && SUCCEEDED(_filter.StreamTime(streamTime))) {
+            const REFERENCE_TIME lateDuration = streamTime - llMulDiv(Environment::GetInstance().GetLateFrameSkipMargin(), UNITS, MILLISECONDS, 0) - frameStopTime;
+            _lateOutputFrameNbLimit = outputFrameNb + static_cast<int>(lateDuration / frameDuration);
+        }
 
-    Environment::GetInstance().Log(L"Output frame: frameNb %6d startTime %10lld stopTime %10lld duration %10lld", outputFrameNb, frameStartTime, frameStopTime, frameDuration);
-
-    if (FAILED(_filter.m_pOutput->GetDeliveryBuffer(&outSample, &frameStartTime, &frameStopTime, 0))) {
-        // avoid releasing the invalid pointer in case the function change it to some random invalid address
-        outSample.Detach();
         return false;
     }
 
+    // a sample passed in is already converted on the callback thread
+    const bool isSampleConverted = outSample != nullptr;
+
+    if (!isSampleConverted) {
+        if (_formatChangeDeliverySample != nullptr) {
+            outSample.Attach(_formatChangeDeliverySample.Detach());
+            _numHeldDeliverySamples -= 1;
+        } else if (TakePooledDeliverySample(outSample)) {
+            _numHeldDeliverySamples -= 1;
+        } else if (FAILED(_filter.m_pOutput->GetDeliveryBuffer(&outSample, &frameStartTime, &frameStopTime, 0))) {
+            // avoid releasing the invalid pointer in case the function change it to some random invalid address
+            outSample.Detach();
+            return false;
+        }
+    }
+
     AM_MEDIA_TYPE *pmtOut;
     outSample->GetMediaType(&pmtOut);
 
     if (const std::shared_ptr<AM_MEDIA_TYPE> pmtOutPtr(pmtOut, &DeleteMediaType);
         pmtOut != nullptr && pmtOut->pbFormat != nullptr) {
-        _filter.m_pOutput->SetMediaType(static_cast<CMediaType *>(pmtOut));
-        _filter._outputVideoFormat = Format::GetVideoFormat(*pmtOut, &MainFrameServer::GetInstance());
-        _notifyChangedOutputMediaType = true;
+        AcceptOutputMediaType(*pmtOut);
     }
 
     if (_notifyChangedOutputMediaType) {
@@ -358,10 +815,8 @@ auto FrameHandler::PrepareOutputSample(ATL::CComPtr<IMediaSample> &outSample, in
         return false;
     }
 
-    if ((_filter._outputVideoFormat.outputBufferTemporalFlags & 0b11) == 0b01) {
-        MEMORY_BASIC_INFORMATION dstBufferInfo;
-        VirtualQuery(outputBuffer, &dstBufferInfo, sizeof(dstBufferInfo));
-        _filter._outputVideoFormat.outputBufferTemporalFlags |= (((dstBufferInfo.Protect & PAGE_WRITECOMBINE) != 0) << 2) + 0b10;
+    if (!isSampleConverted) {
+        ProbeOutputBufferTemporalFlags(outSample);
     }
 
     if (const ATL::CComQIPtr<IMediaSample2> outSample2(outSample); outSample2 != nullptr) {
@@ -384,7 +839,13 @@ auto FrameHandler::PrepareOutputSample(ATL::CComPtr<IMediaSample> &outSample, in
         }
     }
 
-    Format::WriteSample(_filter._outputVideoFormat, outputFrame, outputBuffer);
+    if (!isSampleConverted) {
+        if (outputFrame == _lastOutputFrame && CopyRepeatedOutputSample(outputBuffer, outSample->GetSize())) {
+            Environment::GetInstance().Log(L"Output frame %6d repeats the previous frame", outputFrameNb);
+        } else {
+            Format::WriteSample(_filter._outputVideoFormat, outputFrame, outputBuffer);
+        }
+    }
 
     const auto iter = _sourceFrames.find(sourceFrameNb);
     ASSERT(iter != _sourceFrames.end());
@@ -402,11 +863,14 @@ auto FrameHandler::WorkerProc() -> void {
     const auto ResetOutput = [this]() -> void {
         _nextOutputFrameStartTime = 0;
         _nextDeliveryFrameNb = 0;
+        _lateOutputFrameNbLimit = -1;
 
         _frameRateCheckpointOutputFrameNb = 0;
         _currentOutputFrameRate = 0;
         _frameRateCheckpointDeliveryFrameNb = 0;
         _currentDeliveryFrameRate = 0;
+        _currentOutputLatency = 0;
+        _numSkippedLateFrames = 0;
     };
 
     Environment::GetInstance().Log(L"Start worker thread");
@@ -415,11 +879,19 @@ auto FrameHandler::WorkerProc() -> void {
     SetThreadDescription(GetCurrentThread(), L"CSynthFilter Worker");
 #endif
 
+    ThreadBudget::PinCurrentThread(Environment::GetInstance().GetWorkerThreadAffinity(), L"worker");
+
     ResetOutput();
     _isWorkerLatched = false;
 
     while (true) {
         if (_isFlushing) {
+            // the downstream allocator cannot decommit while its buffers are held, so give them back as soon as no callback can convert into them
+            for (int numPendingOutputCallbacks; (numPendingOutputCallbacks = *_numPendingOutputCallbacks) > 0;) {
+                _numPendingOutputCallbacks->wait(numPendingOutputCallbacks);
+            }
+            ReleaseDeliverySamples();
+
             _isWorkerLatched = true;
             _isWorkerLatched.notify_all();
             _isFlushing.wait(true);
@@ -432,53 +904,118 @@ auto FrameHandler::WorkerProc() -> void {
             _isWorkerLatched = false;
         }
 
-        decltype(_outputFrames)::iterator iter;
-        {
-            std::shared_lock sharedOutputLock(_outputMutex);
+        if (_isScriptSwapPending.exchange(false)) {
+            SwapScript();
+        }
+
+        PrefetchDeliverySamples();
 
-            _deliverSampleCv.wait(sharedOutputLock, [this, &iter]() -> bool {
-                if (_isFlushing) {
-                    return true;
-                }
+        const int outputFrameNb = _nextDeliveryFrameNb;
+        OutputFrameSlot &outputFrameSlot = _outputFrameRing[outputFrameNb % OUTPUT_FRAME_RING_SIZE];
+        const VSFrame *outputFrame = nullptr;
+        bool isOutputFrameFailed = false;
 
-                iter = _outputFrames.find(_nextDeliveryFrameNb);
-                if (iter == _outputFrames.end()) {
-                    return false;
-                }
+        while (true) {
+            const int outputFrameReadyEpoch = _outputFrameReadyEpoch;
+
+            if (_isFlushing
+                || (outputFrame = outputFrameSlot.frame.load(std::memory_order_acquire)) != nullptr
+                || (isOutputFrameFailed = outputFrameSlot.isFailed.load(std::memory_order_acquire))) {
+                break;
+            }
 
-                return iter->second.frame != nullptr;
-            });
+            _outputFrameReadyEpoch.wait(outputFrameReadyEpoch);
         }
 
         if (_isFlushing) {
             continue;
         }
 
-        const VSMap *frameProps = AVSF_VPS_API->getFramePropertiesRO(iter->second.frame);
+        // same as a frame failing to convert, a frame the script fails to generate is not delivered
+        if (isOutputFrameFailed) {
+            outputFrameSlot.isFailed.store(false, std::memory_order_relaxed);
+            Environment::GetInstance().Log(L"Skip failed output frame %6d", outputFrameNb);
+
+            _nextDeliveryFrameNb += 1;
+            RequestOutputFrames();
+            continue;
+        }
+
+        const VSMap *frameProps = AVSF_VPS_API->getFramePropertiesRO(outputFrame);
         int propGetError;
         const int sourceFrameNb = static_cast<int>(AVSF_VPS_API->mapGetInt(frameProps, FRAME_PROP_NAME_SOURCE_FRAME_NB, 0, &propGetError));
 
         _lastUsedSourceFrameNb = sourceFrameNb;
         _addInputSampleCv.notify_all();
 
-        if (ATL::CComPtr<IMediaSample> outSample; PrepareOutputSample(outSample, iter->first, iter->second.frame, sourceFrameNb)) {
-            _filter.m_pOutput->Deliver(outSample);
-            RefreshDeliveryFrameRates(iter->first);
+        ATL::CComPtr<IMediaSample> outSample;
+        if (outputFrameSlot.convertedSample != nullptr) {
+            outSample.Attach(outputFrameSlot.convertedSample.Detach());
+            _numHeldDeliverySamples -= 1;
 
-            Environment::GetInstance().Log(L"Deliver output sample %6d from source frame %6d", iter->first, sourceFrameNb);
+            // the output format changed after the conversion
+            if (outputFrameSlot.formatGeneration != _outputFormatGeneration) {
+                outSample.Release();
+            }
         }
 
-        {
-            const std::unique_lock uniqueOutputLock(_outputMutex);
+        const bool isSamplePrepared = PrepareOutputSample(outSample, outputFrameNb, outputFrame, sourceFrameNb);
 
-            _outputFrames.erase(iter);
+        // keep a copy of the converted data if the next frame is the same one and is not converted ahead, so that it can be copied instead
+        if (const OutputFrameSlot &nextOutputFrameSlot = _outputFrameRing[(outputFrameNb + 1) % OUTPUT_FRAME_RING_SIZE];
+            !isSamplePrepared
+            || nextOutputFrameSlot.frame.load(std::memory_order_acquire) != outputFrame
+            || nextOutputFrameSlot.convertedSample != nullptr) {
+            _lastOutputFrame = nullptr;
+        } else if (BYTE *outputBuffer; _lastOutputFrame != outputFrame) {
+            _lastOutputFrame = SUCCEEDED(outSample->GetPointer(&outputBuffer)) && KeepOutputSampleData(outputBuffer, outSample->GetActualDataLength()) ? outputFrame : nullptr;
         }
 
+        if (isSamplePrepared) {
+            if (REFERENCE_TIME outputStartTime, outputStopTime; SUCCEEDED(outSample->GetTime(&outputStartTime, &outputStopTime))) {
+                _lastDeliveredFrameStartTime = outputStartTime;
+            }
+
+            _filter.m_pOutput->Deliver(outSample);
+            RefreshDeliveryFrameRates(outputFrameNb);
+
+            Environment::GetInstance().Log(L"Deliver output sample %6d from source frame %6d", outputFrameNb, sourceFrameNb);
+
+            if (outputFrameNb == 0) {
+                LogTimeToFirstFrame();
+            }
+        }
+
+        outputFrameSlot.frame.store(nullptr, std::memory_order_release);
+        AVSF_VPS_API->freeFrame(outputFrame);
+
         GarbageCollect(sourceFrameNb - 1);
         _nextDeliveryFrameNb += 1;
+
+        // the ring has room for one more frame
+        RequestOutputFrames();
     }
 
     Environment::GetInstance().Log(L"Stop worker thread");
 }
 
+auto FrameHandler::GetInputFrameDuration() const -> REFERENCE_TIME {
+    // the upstream is free to propose a media type without frame rate
+    if (const VSVideoInfo &inputVideoInfo = _filter._inputVideoFormat.videoInfo; inputVideoInfo.fpsNum > 0 && inputVideoInfo.fpsDen > 0) {
+        return llMulDiv(inputVideoInfo.fpsDen, UNITS, inputVideoInfo.fpsNum, 0);
+    }
+
+    return DEFAULT_AVG_TIME_PER_FRAME;
+}
+
+auto FrameHandler::GetInitialSrcBuffer() -> int {
+    // pre-buffer exactly the lookahead that the script declares
+    const std::shared_lock frameServerLock = MainFrameServer::LockInstance();
+    if (MainFrameServer::GetInstance().IsSourceWindowDeclared()) {
+        return NUM_SRC_FRAMES_PER_PROCESSING + MainFrameServer::GetInstance().GetSourceFutureFrames();
+    }
+
+    return Environment::GetInstance().GetInitialSrcBuffer();
+}
+
 }
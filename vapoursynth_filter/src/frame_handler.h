@@ -4,6 +4,7 @@
 
 #include "frameserver.h"
 #include "hdr.h"
+#include "source_frame_spill.h"
 
 
 namespace SynthFilter {
@@ -26,26 +27,90 @@ public:
     auto GetInputBufferSize() const -> int;
     constexpr auto GetSourceFrameNb() const -> int { return _nextSourceFrameNb; }
     constexpr auto GetOutputFrameNb() const -> int { return _nextOutputFrameNb; }
-    constexpr auto GetDeliveryFrameNb() const -> int { return _nextDeliveryFrameNb; }
+    auto GetDeliveryFrameNb() const -> int { return _nextDeliveryFrameNb; }
     constexpr auto GetCurrentInputFrameRate() const -> int { return _currentInputFrameRate; }
     constexpr auto GetCurrentOutputFrameRate() const -> int { return _currentOutputFrameRate; }
     constexpr auto GetCurrentDeliveryFrameRate() const -> int { return _currentDeliveryFrameRate; }
+    constexpr auto GetCurrentOutputLatency() const -> REFERENCE_TIME { return _currentOutputLatency; }
+    constexpr auto GetNumDroppedSourceFrames() const -> int { return _numDroppedSourceFrames; }
+    constexpr auto GetNumSkippedLateFrames() const -> int { return _numSkippedLateFrames; }
+    constexpr auto GetNumDuplicateSourceFrames() const -> int { return _numDuplicateSourceFrames; }
+    constexpr auto GetNumSpilledSourceFrames() const -> int { return _sourceFrameSpill.GetNumSpills(); }
+    constexpr auto GetNumRefilledSourceFrames() const -> int { return _sourceFrameSpill.GetNumRefills(); }
 
 private:
     struct SourceFrameInfo {
         AutoReleaseVSFrame autoFrame;
         REFERENCE_TIME startTime;
         std::unique_ptr<HDRSideData> hdrSideData;
+
+        // while spilled, the frame only carries the frame properties
+        std::optional<int> spillSlot;
+    };
+
+    struct OutputFrameSlot {
+        std::atomic<const VSFrame *> frame;
+
+        // the script failed to generate the frame
+        std::atomic<bool> isFailed;
+
+        // delivery sample already converted from the frame on the callback thread, if any
+        ATL::CComPtr<IMediaSample> convertedSample;
+        int formatGeneration;
+    };
+
+    struct InputSampleInfo {
+        ATL::CComPtr<IMediaSample> sample;
+        int frameNb;
+        REFERENCE_TIME startTime;
+        REFERENCE_TIME stopTime;
+        DWORD typeSpecificFlags;
+        int numDroppedFramesBefore;
+        Format::VideoFormat videoFormat;
+        std::unique_ptr<HDRSideData> hdrSideData;
     };
 
     static auto VS_CC VpsGetFrameCallback(void *userData, const VSFrame *f, int n, VSNode *node, const char *errorMsg) -> void;
     static auto RefreshFrameRatesTemplate(int sampleNb, int &checkpointSampleNb, std::chrono::steady_clock::time_point &checkpointTime, int &currentFrameRate) -> void;
+    static auto GetInitialSrcBuffer() -> int;
 
     auto ResetInput() -> void;
+    auto IngestionProc() -> void;
+    auto QueueInputSample(InputSampleInfo &&inputSampleInfo) -> bool;
+    auto ReadHDRSideData(IMediaSample *inputSample) -> std::unique_ptr<HDRSideData>;
+    auto IngestInputSample(InputSampleInfo &inputSampleInfo) -> void;
+    auto UpdateIngestionQueueDepth() -> void;
+    auto WaitForIngestionIdle() -> void;
+    auto ShouldDropInputSample() -> bool;
+    auto ShouldSkipLateOutputFrame(int outputFrameNb, REFERENCE_TIME outputStopTime) -> bool;
+    auto StartScriptReload() -> void;
+    auto WaitForScriptReload() -> bool;
+    auto RebaseFrameNumbers() -> bool;
+    auto DetectDuplicateSourceFrame(const BYTE *sampleBuffer, long sampleSize) -> bool;
+    auto CopyRepeatedOutputSample(BYTE *outputBuffer, long outputBufferSize) const -> bool;
+    auto KeepOutputSampleData(const BYTE *outputBuffer, long dataLength) -> bool;
+    auto LogTimeToFirstFrame() const -> void;
+    auto GetInputFrameDuration() const -> REFERENCE_TIME;
+    auto RequestOutputFrames() -> void;
+    auto UpdateDeliverySamplePoolSize() -> void;
+    auto PrefetchDeliverySamples() -> void;
+    auto ConvertOutputFrameAhead(OutputFrameSlot &outputFrameSlot, int outputFrameNb, const VSFrame *outputFrame) -> void;
+    auto TakePooledDeliverySample(ATL::CComPtr<IMediaSample> &outSample) -> bool;
+    auto ReleaseDeliverySamples() -> void;
+    auto ProbeOutputBufferTemporalFlags(IMediaSample *outSample) -> void;
+    auto AcceptOutputMediaType(const AM_MEDIA_TYPE &mediaType) -> void;
     auto PrepareOutputSample(ATL::CComPtr<IMediaSample> &outSample, int outputFrameNb, const VSFrame *outputFrame, int sourceFrameNb) -> bool;
     auto WorkerProc() -> void;
+    auto PageOutSourceFrame(SourceFrameInfo &sourceFrame) -> bool;
+    auto PageInSourceFrame(SourceFrameInfo &sourceFrame) -> bool;
+    auto RefillSourceFrame(int frameNb) -> const VSFrame *;
+    auto SpillSourceFrames(int hotFrameNb, int pinnedFirstFrameNb, int pinnedLastFrameNb) -> void;
     auto GarbageCollect(int srcFrameNb) -> void;
     auto ChangeOutputFormat() -> bool;
+    auto PrepareScriptSwap() -> bool;
+    auto AbandonScriptSwapProbe() -> void;
+    auto SwapScript() -> void;
+    auto RetireMainFrameServer(std::unique_ptr<MainFrameServer> retiredFrameServer) -> void;
     auto UpdateExtraSrcBuffer() -> void;
     auto RefreshInputFrameRates(int frameNb) -> void;
     auto RefreshOutputFrameRates(int frameNb) -> void;
@@ -53,29 +118,80 @@ private:
 
     static constexpr const int NUM_SRC_FRAMES_PER_PROCESSING = 2;
 
+    /*
+     * Output frames are reordered in a ring indexed by output frame number. No frame is requested beyond this distance from the next frame to deliver.
+     */
+    static constexpr const int OUTPUT_FRAME_RING_SIZE = 128;
+
     CSynthFilter &_filter;
 
     std::map<int, SourceFrameInfo> _sourceFrames;
-    std::map<int, AutoReleaseVSFrame> _outputFrames;
+    std::array<OutputFrameSlot, OUTPUT_FRAME_RING_SIZE> _outputFrameRing {};
+    SourceFrameSpill _sourceFrameSpill;
 
     mutable std::shared_mutex _sourceMutex;
-    std::shared_mutex _outputMutex;
+    std::mutex _outputRequestMutex;
+    std::mutex _deliverySamplePoolMutex;
+    std::shared_mutex _outputFormatMutex;
 
     std::condition_variable_any _addInputSampleCv;
     std::condition_variable_any _newSourceFrameCv;
-    std::condition_variable_any _deliverSampleCv;
-    std::condition_variable_any _flushOutputSampleCv;
+    std::atomic<int> _outputFrameReadyEpoch = 0;
+    std::atomic<int> _outputRequestEpoch = 0;
 
     int _nextSourceFrameNb;
     int _nextProcessSourceFrameNb;
     int _nextOutputFrameNb;
+    int _maxRequestOutputFrameNb;
+    std::atomic<int> _numInFlightOutputFrames;
+    const std::shared_ptr<std::atomic<int>> _numPendingOutputCallbacks = std::make_shared<std::atomic<int>>(0);
+    int _maxInFlightOutputFrames = 1;
+    std::vector<ATL::CComPtr<IMediaSample>> _deliverySamplePool;
+    ATL::CComPtr<IMediaSample> _formatChangeDeliverySample;
+    std::atomic<int> _numHeldDeliverySamples = 0;
+    std::atomic<int> _maxHeldDeliverySamples = 0;
+    int _outputFormatGeneration = 0;
     REFERENCE_TIME _nextOutputFrameStartTime;
+    std::atomic<REFERENCE_TIME> _lastSourceFrameStartTime;
     std::atomic<int> _lastUsedSourceFrameNb;
+    bool _isMainScriptReady;
+    std::atomic<int> _initialSrcBuffer;
     bool _notifyChangedOutputMediaType;
-    int _nextDeliveryFrameNb;
+    const VSFrame *_lastOutputFrame = nullptr;
+    std::vector<BYTE> _lastOutputData;
+    std::atomic<int> _nextDeliveryFrameNb;
     int _extraSrcBuffer;
 
+    // the output frames up to this one are expected to be skipped as late by the worker
+    std::atomic<int> _lateOutputFrameNbLimit = -1;
+
     std::thread _workerThread;
+    std::thread _ingestionThread;
+    std::deque<InputSampleInfo> _pendingInputSamples;
+    std::mutex _ingestionMutex;
+    std::condition_variable _ingestionCv;
+    size_t _maxPendingInputSamples = 1;
+    bool _isIngesting = false;
+    std::atomic<REFERENCE_TIME> _lastDeliveredFrameStartTime;
+    bool _isOverloaded;
+    int _numConsecutiveDroppedSourceFrames;
+    int _numDroppedSourceFrames;
+    int _numSkippedLateFrames;
+    std::optional<uint64_t> _lastSourceFrameHash;
+    int _numDuplicateSourceFrames;
+    std::shared_future<bool> _scriptReloadFuture;
+    int _sourceFrameNbBase = 0;
+    int _outputFrameNbBase = 0;
+    std::chrono::steady_clock::time_point _firstSourceFrameTime;
+
+    // a changed script with unchanged output format is evaluated on a separate main frameserver, then swapped in by the worker
+    std::future<std::unique_ptr<MainFrameServer>> _scriptSwapProbe;
+    std::vector<std::future<std::unique_ptr<MainFrameServer>>> _abandonedScriptSwapProbes;
+    std::filesystem::path _scriptSwapPath;
+    std::unique_ptr<MainFrameServer> _scriptSwapFrameServer;
+    std::future<void> _retiredFrameServerRelease;
+    std::atomic<bool> _isScriptSwapPending = false;
+    bool _isScriptSwapping = false;
 
     std::atomic<bool> _isFlushing = false;
     std::atomic<bool> _isStopping = false;
@@ -90,6 +206,7 @@ private:
     int _currentInputFrameRate;
     int _currentOutputFrameRate;
     int _currentDeliveryFrameRate;
+    REFERENCE_TIME _currentOutputLatency;
 };
 
 }
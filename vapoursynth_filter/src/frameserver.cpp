@@ -5,6 +5,7 @@
 #include "api.h"
 #include "constants.h"
 #include "filter.h"
+#include "thread_budget.h"
 
 
 namespace SynthFilter {
@@ -14,16 +15,11 @@ namespace {
 constexpr const char *VPS_VAR_NAME_SOURCE_NODE = "VpsFilterSource";
 constexpr const char *VPS_VAR_NAME_DISCONNECT  = "VpsFilterDisconnect";
 constexpr const char *VPS_VAR_NAME_SOURCE_PATH = "VpsFilterSourcePath";
+constexpr const char *VPS_VAR_NAME_SOURCE_PAST   = "VpsFilterSourcePast";
+constexpr const char *VPS_VAR_NAME_SOURCE_FUTURE = "VpsFilterSourceFuture";
 
 auto VS_CC SourceGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) -> const VSFrame * {
-    const CSynthFilter *filter = reinterpret_cast<const CSynthFilter *>(instanceData);
-
-    if (filter == nullptr) {
-        Environment::GetInstance().Log(L"Source frame %6d is requested without the frame handler being linked", n);
-        return FrameServerCommon::GetInstance().CreateSourceDummyFrame(core);
-    } else {
-        return filter->frameHandler->GetSourceFrame(n);
-    }
+    return static_cast<const FrameServerBase *>(instanceData)->GetSourceFrame(n, core);
 }
 
 }
@@ -61,14 +57,21 @@ FrameServerCommon::FrameServerCommon() {
     VSCore *vsCore = _vsApi->createCore(0);
     VSCoreInfo coreInfo;
     _vsApi->getCoreInfo(vsCore, &coreInfo);
+
+    // the core autoloads the plugins on creation
+    std::vector<std::filesystem::path> pluginPaths;
+    for (VSPlugin *plugin = _vsApi->getNextPlugin(nullptr, vsCore); plugin != nullptr; plugin = _vsApi->getNextPlugin(plugin, vsCore)) {
+        if (const char *pluginPath = _vsApi->getPluginPath(plugin); pluginPath != nullptr && pluginPath[0] != '\0') {
+            pluginPaths.emplace_back(ConvertUtf8ToWide(pluginPath));
+        }
+    }
+
     _vsApi->freeCore(vsCore);
 
     _versionString = std::format("VapourSynth R{} API R{}.{}", coreInfo.core, coreInfo.api >> 16, coreInfo.api & 0xffff);
     Environment::GetInstance().Log(L"VapourSynth version: %hs", GetVersionString().data());
-}
 
-auto FrameServerCommon::CreateSourceDummyFrame(VSCore *core) const -> const VSFrame * {
-    return _vsApi->newVideoFrame(&_sourceVideoInfo.format, _sourceVideoInfo.width, _sourceVideoInfo.height, nullptr, core);
+    _frameServerHash = ScriptProbeKey::HashFrameServer(GetVersionString(), pluginPaths);
 }
 
 auto FrameServerBase::StopScript() -> void {
@@ -79,13 +82,33 @@ auto FrameServerBase::StopScript() -> void {
     }
 }
 
+auto FrameServerBase::GetSourceFrame(int frameNb, VSCore *core) const -> const VSFrame * {
+    if (_sourceFilter == nullptr) {
+        Environment::GetInstance().Log(L"Source frame %6d is requested without the frame handler being linked", frameNb);
+        return AVSF_VPS_API->newVideoFrame(&_sourceVideoInfo.format, _sourceVideoInfo.width, _sourceVideoInfo.height, nullptr, core);
+    }
+
+    if (const VSFrame *frame = _sourceFilter->frameHandler->GetSourceFrame(frameNb)) {
+        return frame;
+    }
+
+    return GetSourceDummyFrame();
+}
+
 FrameServerBase::FrameServerBase() {
     _vsScript = AVSF_VPS_SCRIPT_API->createScript(nullptr);
     _vsCore = AVSF_VPS_SCRIPT_API->getCore(_vsScript);
+
+    // without a configured budget, the core keeps one thread per logical core
+    if (Environment::GetInstance().GetThreadBudget() > 0) {
+        const int numThreads = AVSF_VPS_API->setThreadCount(ThreadBudget::GetFrameServerThreads(), _vsCore);
+        Environment::GetInstance().Log(L"Set VapourSynth core threads: %d", numThreads);
+    }
 }
 
 FrameServerBase::~FrameServerBase() {
     StopScript();
+    _sourceDummyFrame = nullptr;
     AVSF_VPS_API->freeNode(_sourceClip);
     AVSF_VPS_SCRIPT_API->freeScript(_vsScript);
 }
@@ -97,9 +120,9 @@ auto FrameServerBase::ReloadScript(const AM_MEDIA_TYPE &mediaType, bool ignoreDi
     StopScript();
     AVSF_VPS_API->freeNode(_sourceClip);
 
-    const VSVideoInfo &sourceVideoInfo = Format::GetVideoFormat(mediaType, this).videoInfo;
-    FrameServerCommon::GetInstance()._sourceVideoInfo = sourceVideoInfo;
-    _sourceClip = AVSF_VPS_API->createVideoFilter2("VpsFilter_Source", &sourceVideoInfo, SourceGetFrame, nullptr, fmParallelRequests, nullptr, 0, const_cast<CSynthFilter *>(filter), GetVsCore());
+    _sourceVideoInfo = Format::GetVideoFormat(mediaType, this).videoInfo;
+    _sourceFilter = filter;
+    _sourceClip = AVSF_VPS_API->createVideoFilter2("VpsFilter_Source", &_sourceVideoInfo, SourceGetFrame, nullptr, fmParallelRequests, nullptr, 0, this, GetVsCore());
     AVSF_VPS_API->setCacheMode(_sourceClip, 0);
 
     VSMap *sourceInputs = AVSF_VPS_API->createMap();
@@ -116,6 +139,9 @@ auto FrameServerBase::ReloadScript(const AM_MEDIA_TYPE &mediaType, bool ignoreDi
     AVSF_VPS_API->freeMap(sourceInputs);
 
     _errorString.clear();
+    _isSourceWindowDeclared = false;
+    _sourcePastFrames = 0;
+    _sourceFutureFrames = 0;
 
     bool toDisconnect = false;
 
@@ -130,6 +156,15 @@ auto FrameServerBase::ReloadScript(const AM_MEDIA_TYPE &mediaType, bool ignoreDi
             if (AVSF_VPS_API->mapNumElements(scriptOutputs, VPS_VAR_NAME_DISCONNECT) == 1) {
                 toDisconnect = AVSF_VPS_API->mapGetInt(scriptOutputs, VPS_VAR_NAME_DISCONNECT, 0, nullptr) != 0;
             }
+
+            // scripts may declare how many source frames around the current one they read, e.g. VpsFilterSourcePast = 3
+            for (const auto &[varName, windowFrames] : { std::pair { VPS_VAR_NAME_SOURCE_PAST, &_sourcePastFrames }, std::pair { VPS_VAR_NAME_SOURCE_FUTURE, &_sourceFutureFrames } }) {
+                AVSF_VPS_SCRIPT_API->getVariable(_vsScript, varName, scriptOutputs);
+                if (AVSF_VPS_API->mapNumElements(scriptOutputs, varName) == 1) {
+                    _isSourceWindowDeclared = true;
+                    *windowFrames = std::max(static_cast<int>(AVSF_VPS_API->mapGetInt(scriptOutputs, varName, 0, nullptr)), 0);
+                }
+            }
             AVSF_VPS_API->freeMap(scriptOutputs);
         } else {
             _errorString = AVSF_VPS_SCRIPT_API->getError(_vsScript);
@@ -159,6 +194,9 @@ core.text.Text({}, r'''{}''').set_output()",
     }
 
     Environment::GetInstance().Log(L"New script clip: %p", _scriptClip);
+    if (_isSourceWindowDeclared) {
+        Environment::GetInstance().Log(L"Script declares source window: past %d future %d", _sourcePastFrames, _sourceFutureFrames);
+    }
     const VSVideoInfo *scriptVideoInfo = AVSF_VPS_API->getVideoInfo(_scriptClip);
     _scriptAvgFrameDuration = llMulDiv(scriptVideoInfo->fpsDen, UNITS, scriptVideoInfo->fpsNum, 0);
 
@@ -168,26 +206,56 @@ core.text.Text({}, r'''{}''').set_output()",
 auto MainFrameServer::ReloadScript(const AM_MEDIA_TYPE &mediaType, bool ignoreDisconnect) -> bool {
     Environment::GetInstance().Log(L"ReloadScript from main frameserver");
 
+    // the script may drain source frames during evaluation, so the shared dummy frame has to exist before that
+    const VSVideoInfo sourceVideoInfo = Format::GetVideoFormat(mediaType, this).videoInfo;
+    _sourceDummyFrame = AVSF_VPS_API->newVideoFrame(&sourceVideoInfo.format, sourceVideoInfo.width, sourceVideoInfo.height, nullptr, GetVsCore());
+
     if (__super::ReloadScript(mediaType, ignoreDisconnect, _filter)) {
-        const VSVideoInfo &sourceVideoInfo = FrameServerCommon::GetInstance()._sourceVideoInfo;
-        _sourceAvgFrameRate = static_cast<int>(llMulDiv(sourceVideoInfo.fpsNum, FRAME_RATE_SCALE_FACTOR, sourceVideoInfo.fpsDen, 0));
-        _sourceAvgFrameDuration = llMulDiv(sourceVideoInfo.fpsDen, UNITS, sourceVideoInfo.fpsNum, 0);
+        _sourceAvgFrameRate = static_cast<int>(llMulDiv(_sourceVideoInfo.fpsNum, FRAME_RATE_SCALE_FACTOR, _sourceVideoInfo.fpsDen, 0));
+        _sourceAvgFrameDuration = llMulDiv(_sourceVideoInfo.fpsDen, UNITS, _sourceVideoInfo.fpsNum, 0);
+
+        // a non-positive size keeps the current limit of the core
+        const int64_t cacheBytes = AVSF_VPS_API->setMaxCacheSize(CalculateCacheLimit(mediaType) * 1024LL * 1024, GetVsCore());
+        _cacheLimit = static_cast<int>(cacheBytes / (1024 * 1024));
+        Environment::GetInstance().Log(L"Frameserver cache limit: %d MiB", _cacheLimit);
+
         return true;
     }
 
     return false;
 }
 
+/**
+ * Every drained source frame references the same dummy frame instead of allocating a new one.
+ */
+auto FrameServerBase::GetSourceDummyFrame() const -> const VSFrame * {
+    return AVSF_VPS_API->addFrameRef(_sourceDummyFrame.frame);
+}
+
 auto AuxFrameServer::ReloadScript(const AM_MEDIA_TYPE &mediaType, bool ignoreDisconnect) -> bool {
+    _probeCache.Load(FrameServerCommon::GetInstance().GetVersionString());
+
+    const std::optional<ScriptProbeKey> optProbeKey = ScriptProbeKey::Create(FrameServerCommon::GetInstance()._scriptPath, FrameServerCommon::GetInstance()._frameServerHash, mediaType, ignoreDisconnect, VPS_VAR_NAME_SOURCE_PATH);
+    if (const std::optional<ProbeResult> optProbeResult = optProbeKey ? _probeCache.Find<ProbeResult>(*optProbeKey) : std::nullopt) {
+        Environment::GetInstance().Log(L"Reuse probe result from auxiliary frameserver");
+
+        _sourceVideoInfo = Format::GetVideoFormat(mediaType, this).videoInfo;
+        _scriptVideoInfo = optProbeResult->scriptVideoInfo;
+        return optProbeResult->isAccepted;
+    }
+
     Environment::GetInstance().Log(L"ReloadScript from auxiliary frameserver");
 
-    if (__super::ReloadScript(mediaType, ignoreDisconnect, nullptr)) {
+    const bool isAccepted = __super::ReloadScript(mediaType, ignoreDisconnect, nullptr);
+    if (isAccepted) {
         _scriptVideoInfo = *AVSF_VPS_API->getVideoInfo(_scriptClip);
-        StopScript();
-        return true;
     }
+    StopScript();
 
-    return false;
+    if (optProbeKey) {
+        _probeCache.Store(*optProbeKey, ProbeResult { isAccepted, _scriptVideoInfo });
+    }
+    return isAccepted;
 }
 
 auto AuxFrameServer::GetScriptPixelType() const -> uint32_t {
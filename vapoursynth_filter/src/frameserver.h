@@ -4,6 +4,7 @@
 
 #include "environment.h"
 #include "format.h"
+#include "script_probe.h"
 #include "singleton.h"
 
 
@@ -35,7 +36,6 @@ public:
 
     DISABLE_COPYING(FrameServerCommon)
 
-    auto CreateSourceDummyFrame(VSCore *core) const -> const VSFrame *;
     auto SetScriptPath(const std::filesystem::path &scriptPath) -> void;
     constexpr auto GetVersionString() const -> std::string_view { return _versionString; }
     constexpr auto GetScriptPath() const -> const std::filesystem::path & { return _scriptPath; }
@@ -45,9 +45,11 @@ public:
 private:
     std::filesystem::path _scriptPath = Environment::GetInstance().GetScriptPath();
     std::string _versionString;
+
+    // identifies the frameserver version together with its plugins for the script probe results
+    uint64_t _frameServerHash = 0;
     const VSAPI *_vsApi;
     const VSSCRIPTAPI *_vsScriptApi;
-    VSVideoInfo _sourceVideoInfo {};
 };
 
 #define AVSF_VPS_API        FrameServerCommon::GetInstance().GetVsApi()
@@ -58,6 +60,8 @@ class CSynthFilter;
 class FrameServerBase {
 public:
     constexpr auto GetVsCore() const -> VSCore * { return _vsCore; }
+    auto GetSourceFrame(int frameNb, VSCore *core) const -> const VSFrame *;
+    auto GetSourceDummyFrame() const -> const VSFrame *;
 
 protected:
     FrameServerBase();
@@ -70,10 +74,18 @@ protected:
 
     VSScript *_vsScript = nullptr;
     VSCore *_vsCore = nullptr;
+    VSVideoInfo _sourceVideoInfo {};
+    const CSynthFilter *_sourceFilter = nullptr;
     VSNode *_sourceClip = nullptr;
     VSNode *_scriptClip = nullptr;
     REFERENCE_TIME _scriptAvgFrameDuration = 0;
     std::string _errorString;
+    bool _isSourceWindowDeclared = false;
+    int _sourcePastFrames = 0;
+    int _sourceFutureFrames = 0;
+
+    // returned for the drained source frames, allocated by the core that reads them
+    AutoReleaseVSFrame _sourceDummyFrame;
 };
 
 class MainFrameServer
@@ -86,14 +98,22 @@ public:
     using FrameServerBase::StopScript;
     constexpr auto LinkSynthFilter(const CSynthFilter *filter) -> void { _filter = filter; }
     constexpr auto GetScriptClip() const -> VSNode * { return _scriptClip; }
+    auto IsScriptActive() const -> bool;
     constexpr auto GetSourceAvgFrameDuration() const -> REFERENCE_TIME { return _sourceAvgFrameDuration; }
     constexpr auto GetSourceAvgFrameRate() const -> int { return _sourceAvgFrameRate; }
     constexpr auto GetScriptAvgFrameDuration() const -> REFERENCE_TIME { return _scriptAvgFrameDuration; }
+    constexpr auto IsSourceWindowDeclared() const -> bool { return _isSourceWindowDeclared; }
+    constexpr auto GetSourcePastFrames() const -> int { return _sourcePastFrames; }
+    constexpr auto GetSourceFutureFrames() const -> int { return _sourceFutureFrames; }
+    constexpr auto GetCacheLimit() const -> int { return _cacheLimit; }
     auto GetErrorString() const -> std::optional<std::string>;
 
 private:
+    auto CalculateCacheLimit(const AM_MEDIA_TYPE &mediaType) const -> int;
+
     REFERENCE_TIME _sourceAvgFrameDuration = 0;
     int _sourceAvgFrameRate = 0;
+    int _cacheLimit = 0;
     const CSynthFilter *_filter = nullptr;
 };
 
@@ -108,7 +128,16 @@ public:
     auto GetScriptPixelType() const -> uint32_t;
 
 private:
+    struct ProbeResult {
+        bool isAccepted;
+        VSVideoInfo scriptVideoInfo;
+    };
+
     VSVideoInfo _scriptVideoInfo;
+
+    // evaluating the script is costly, so probing the same media type again should not
+    // shared by the auxiliary frameservers that probe concurrently
+    static inline ScriptProbeCache _probeCache;
 };
 
 }